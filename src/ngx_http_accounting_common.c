@@ -2,5 +2,108 @@
 #include <ngx_core.h>
 
 #include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_status_code.h"
+#include "ngx_http_accounting_hll.h"
 
 
+ngx_http_accounting_distinct_t  *ngx_http_accounting_distincts;
+ngx_uint_t                       ngx_http_accounting_nr_distincts = 0;
+
+
+void
+ngx_http_accounting_stats_add(ngx_http_accounting_stats_t *dst,
+        ngx_http_accounting_stats_t *src)
+{
+    ngx_uint_t   i;
+
+    dst->nr_requests += src->nr_requests;
+    dst->nr_sampled += src->nr_sampled;
+    dst->bytes_in += src->bytes_in;
+    dst->bytes_out += src->bytes_out;
+    dst->total_latency_ms += src->total_latency_ms;
+    dst->upstream_total_latency_ms += src->upstream_total_latency_ms;
+    dst->upstream_connect_ms += src->upstream_connect_ms;
+    dst->upstream_header_ms += src->upstream_header_ms;
+    dst->upstream_attempts += src->upstream_attempts;
+    dst->upstream_retries += src->upstream_retries;
+    dst->upstream_errors += src->upstream_errors;
+    dst->cpu_ns += src->cpu_ns;
+    dst->in_flight += src->in_flight;
+    dst->max_in_flight += src->max_in_flight;
+
+    for (i = 0; i < NGX_HTTP_ACCOUNTING_SLO_MAX_LATENCIES; i++) {
+        dst->slow[i] += src->slow[i];
+    }
+
+    for (i = 0; i < http_status_code_count; i++) {
+        dst->http_status_code[i] += src->http_status_code[i];
+    }
+
+    for (i = 0; i < NGX_HTTP_ACCOUNTING_SIZE_BUCKETS; i++) {
+        dst->size_in[i] += src->size_in[i];
+        dst->size_out[i] += src->size_out[i];
+    }
+
+    if (dst->top && src->top) {
+        ngx_http_accounting_top_merge(&dst->top[NGX_HTTP_ACCOUNTING_TOP_SLOW],
+                                      &src->top[NGX_HTTP_ACCOUNTING_TOP_SLOW]);
+        ngx_http_accounting_top_merge(&dst->top[NGX_HTTP_ACCOUNTING_TOP_LARGE],
+                                      &src->top[NGX_HTTP_ACCOUNTING_TOP_LARGE]);
+    }
+
+    for (i = 0; i < ngx_http_accounting_nr_distincts; i++) {
+        ngx_http_accounting_hll_merge(dst->distinct[i], src->distinct[i],
+                                      ngx_http_accounting_distincts[i].precision);
+    }
+}
+
+void
+ngx_http_accounting_stats_reset(ngx_http_accounting_stats_t *stats)
+{
+    ngx_uint_t   i;
+
+    stats->nr_requests = 0;
+    stats->nr_sampled = 0;
+    stats->bytes_out = 0;
+    stats->bytes_in = 0;
+    stats->total_latency_ms = 0;
+    stats->upstream_total_latency_ms = 0;
+    stats->upstream_connect_ms = 0;
+    stats->upstream_header_ms = 0;
+    stats->upstream_attempts = 0;
+    stats->upstream_retries = 0;
+    stats->upstream_errors = 0;
+    stats->cpu_ns = 0;
+    stats->max_running = stats->running;
+
+    ngx_memzero(stats->http_status_code, sizeof(ngx_uint_t) * http_status_code_count);
+    ngx_memzero(stats->size_in, sizeof(stats->size_in));
+    ngx_memzero(stats->size_out, sizeof(stats->size_out));
+    ngx_memzero(stats->slow, sizeof(stats->slow));
+
+    if (stats->top) {
+        stats->top[NGX_HTTP_ACCOUNTING_TOP_SLOW].n = 0;
+        stats->top[NGX_HTTP_ACCOUNTING_TOP_LARGE].n = 0;
+    }
+
+    for (i = 0; i < ngx_http_accounting_nr_distincts; i++) {
+        ngx_memzero(stats->distinct[i], (size_t) 1 << ngx_http_accounting_distincts[i].precision);
+    }
+}
+
+// buckets has 10 entries, one per status class with 499 counted separately in [9]
+void
+ngx_http_accounting_stats_status_classes(ngx_http_accounting_stats_t *stats, ngx_uint_t *buckets)
+{
+    ngx_uint_t   i;
+
+    ngx_memzero(buckets, sizeof(ngx_uint_t) * 10);
+
+    for (i = 0; i < http_status_code_count; i++) {
+        if (index_to_http_status_code_map[i] == NGX_HTTP_CLIENT_CLOSED_REQUEST) {
+            buckets[9] += stats->http_status_code[i];
+        } else {
+            buckets[index_to_http_status_code_map[i] / 100] += stats->http_status_code[i];
+        }
+    }
+}
@@ -4,17 +4,75 @@
 #include <ngx_config.h>
 #include <ngx_core.h>
 
+#include "ngx_http_accounting_top.h"
+#include "ngx_http_accounting_size.h"
+
 
 #define ACCOUNTING_ID_MAX_LEN               10
 #define NGX_HTTP_ACCOUNTING_NR_BUCKETS      107
+#define NGX_HTTP_ACCOUNTING_MAX_DEPTH       8
+#define NGX_HTTP_ACCOUNTING_MAX_DISTINCT    4
+#define NGX_HTTP_ACCOUNTING_SLO_MAX_LATENCIES  4
+#define NGX_HTTP_ACCOUNTING_MAX_SAMPLE_SHIFT 16
+
+#define NGX_HTTP_ACCOUNTING_TOP_SLOW        0   /* by latency */
+#define NGX_HTTP_ACCOUNTING_TOP_LARGE       1   /* by bytes in and out */
+
+typedef struct ngx_http_accounting_quota_s  ngx_http_accounting_quota_t;
+
+typedef struct ngx_http_accounting_slo_s    ngx_http_accounting_slo_t;
+
+typedef struct ngx_http_accounting_history_s  ngx_http_accounting_history_t;
+
+typedef struct ngx_http_accounting_stats_s  ngx_http_accounting_stats_t;
 
 typedef struct {
+    ngx_str_t        name;          /* variable name, without '$' */
+    ngx_int_t        index;
+    ngx_uint_t       precision;     /* log2 of the number of registers */
+} ngx_http_accounting_distinct_t;
+
+struct ngx_http_accounting_stats_s {
+    ngx_str_t        name;
+    ngx_uint_t       level;
+    ngx_http_accounting_stats_t  *parent;
+    ngx_http_accounting_stats_t  *next;     /* next entry on the same level */
+    ngx_http_accounting_stats_t  *other;    /* "~other" child, once the level below is full */
+
     ngx_uint_t       nr_requests;
+    ngx_uint_t       nr_sampled;    /* requests that updated the sampled dimensions */
     ngx_uint_t       bytes_in;
     ngx_uint_t       bytes_out;
     ngx_uint_t       total_latency_ms;
     ngx_uint_t       upstream_total_latency_ms;
+    ngx_uint_t       upstream_connect_ms;
+    ngx_uint_t       upstream_header_ms;
+    ngx_uint_t       upstream_attempts;
+    ngx_uint_t       upstream_retries;
+    ngx_uint_t       upstream_errors;
+    ngx_uint_t       running;       /* gauge of the requests of this id only */
+    ngx_uint_t       max_running;   /* peak of running within the interval */
+    ngx_uint_t       in_flight;     /* running of the subtree, set at the flush */
+    ngx_uint_t       max_in_flight; /* max_running of the subtree, summed at the flush */
+    ngx_uint_t       cpu_ns;        /* of sampled requests, preaccess to log phase */
     ngx_uint_t      *http_status_code;
-} ngx_http_accounting_stats_t;
+    ngx_uint_t       size_in[NGX_HTTP_ACCOUNTING_SIZE_BUCKETS];     /* log2 histograms, */
+    ngx_uint_t       size_out[NGX_HTTP_ACCOUNTING_SIZE_BUCKETS];    /* see ngx_http_accounting_size.h */
+    uint8_t         *distinct[NGX_HTTP_ACCOUNTING_MAX_DISTINCT];
+    ngx_uint_t       slow[NGX_HTTP_ACCOUNTING_SLO_MAX_LATENCIES];   /* above each SLO latency */
+    ngx_http_accounting_quota_t  *quota;
+    ngx_http_accounting_slo_t    *slo;
+    ngx_uint_t       history;       /* slot in the history zone + 1, 0 if not looked up yet */
+    ngx_http_accounting_top_t    *top;      /* slowest and largest requests, NULL until needed */
+};
+
+extern ngx_http_accounting_distinct_t  *ngx_http_accounting_distincts;
+extern ngx_uint_t                       ngx_http_accounting_nr_distincts;
+
+void ngx_http_accounting_stats_add(ngx_http_accounting_stats_t *dst,
+                ngx_http_accounting_stats_t *src);
+void ngx_http_accounting_stats_reset(ngx_http_accounting_stats_t *stats);
+void ngx_http_accounting_stats_status_classes(ngx_http_accounting_stats_t *stats,
+                ngx_uint_t *buckets);
 
 #endif /* _NGX_HTTP_ACCOUNTING_COMMON_H_INCLUDED_ */
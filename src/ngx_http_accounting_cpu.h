@@ -0,0 +1,57 @@
+#ifndef _NGX_HTTP_ACCOUNTING_CPU_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_CPU_H_INCLUDED_
+
+/*
+ * CPU attribution of sampled requests: the clock is read once when a request
+ * enters the preaccess phase and once in its log phase, and the difference is
+ * charged to its id. Only depends on libc.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+
+#define NGX_HTTP_ACCOUNTING_CPU_OFF      0
+#define NGX_HTTP_ACCOUNTING_CPU_THREAD   1  /* CLOCK_THREAD_CPUTIME_ID, ns */
+#define NGX_HTTP_ACCOUNTING_CPU_TSC      2  /* time stamp counter, cycles of wall time */
+
+
+// off reads CLOCK_MONOTONIC in ns, to calibrate the time stamp counter against
+static inline uint64_t
+ngx_http_accounting_cpu_clock(unsigned mode)
+{
+    struct timespec  ts;
+
+#if defined(__x86_64__) || defined(__i386__)
+    if (mode == NGX_HTTP_ACCOUNTING_CPU_TSC) {
+        return __rdtsc();
+    }
+#endif
+
+    clock_gettime(mode == NGX_HTTP_ACCOUNTING_CPU_THREAD ? CLOCK_THREAD_CPUTIME_ID
+                                                         : CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+// ns since start, scale converts clock units into ns; a clock that went back counts 0
+static inline uint64_t
+ngx_http_accounting_cpu_elapsed(uint64_t start, unsigned mode, double scale)
+{
+    uint64_t  now;
+
+    now = ngx_http_accounting_cpu_clock(mode);
+
+    if (now <= start) {
+        return 0;
+    }
+
+    return (uint64_t) ((now - start) * scale + 0.5);
+}
+
+#endif /* _NGX_HTTP_ACCOUNTING_CPU_H_INCLUDED_ */
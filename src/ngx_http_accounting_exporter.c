@@ -0,0 +1,622 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_event.h>
+#include <ngx_event_connect.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_module.h"
+#include "ngx_http_accounting_exporter.h"
+#include "ngx_http_accounting_otlp.h"
+
+
+#define NGX_HTTP_ACCOUNTING_EXPORTER_PORT       4318
+#define NGX_HTTP_ACCOUNTING_EXPORTER_URI        "/v1/metrics"
+#define NGX_HTTP_ACCOUNTING_EXPORTER_BUFFER     (1024 * 1024)
+#define NGX_HTTP_ACCOUNTING_EXPORTER_TIMEOUT    5000
+#define NGX_HTTP_ACCOUNTING_EXPORTER_HOST_LEN   256
+
+#define NGX_HTTP_ACCOUNTING_EXPORTER_HEADER     512
+#define NGX_HTTP_ACCOUNTING_EXPORTER_ATTEMPTS   3
+
+// values per row, in the order of the metrics below
+#define NGX_HTTP_ACCOUNTING_EXPORTER_VALUES     (17 + 2 * NGX_HTTP_ACCOUNTING_SIZE_BUCKETS)
+
+// one encoded POST, header and body, waiting to be sent
+typedef struct {
+    ngx_queue_t      queue;
+    size_t           size;          /* of data */
+    u_char          *start;         /* of the header, the body follows at data + HEADER */
+    size_t           len;
+    size_t           sent;
+    ngx_uint_t       attempts;
+    u_char           data[1];
+} ngx_http_accounting_exporter_request_t;
+
+
+static const char *const  ngx_http_accounting_exporter_classes[] = {
+    "1xx", "2xx", "3xx", "4xx", "5xx", "499"
+};
+
+// upper bounds of the size buckets, 2^n - 1 bytes, see ngx_http_accounting_size.h
+static double  ngx_http_accounting_exporter_size_bounds[NGX_HTTP_ACCOUNTING_SIZE_BUCKETS - 1];
+
+static const ngx_http_accounting_otlp_metric_t  ngx_http_accounting_exporter_metrics[] = {
+    { "nginx.accounting.requests", "{request}", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.bytes_in", "By", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.bytes_out", "By", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.latency", "ms", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.upstream.latency", "ms", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.upstream.attempts", "{attempt}", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.upstream.retries", "{attempt}", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.upstream.errors", "{attempt}", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.responses", "{response}", NGX_HTTP_ACCOUNTING_OTLP_SUM, 6,
+      "http.status_class", ngx_http_accounting_exporter_classes },
+    { "nginx.accounting.in_flight", "{request}", NGX_HTTP_ACCOUNTING_OTLP_GAUGE, 1, NULL, NULL },
+    { "nginx.accounting.in_flight.max", "{request}", NGX_HTTP_ACCOUNTING_OTLP_GAUGE, 1, NULL, NULL },
+    { "nginx.accounting.cpu.time", "ns", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.request.size", "By", NGX_HTTP_ACCOUNTING_OTLP_HISTOGRAM,
+      NGX_HTTP_ACCOUNTING_SIZE_BUCKETS, NULL, NULL, ngx_http_accounting_exporter_size_bounds },
+    { "nginx.accounting.response.size", "By", NGX_HTTP_ACCOUNTING_OTLP_HISTOGRAM,
+      NGX_HTTP_ACCOUNTING_SIZE_BUCKETS, NULL, NULL, ngx_http_accounting_exporter_size_bounds },
+};
+
+#define NGX_HTTP_ACCOUNTING_EXPORTER_NR_METRICS                                   \
+    (sizeof(ngx_http_accounting_exporter_metrics)                                 \
+     / sizeof(ngx_http_accounting_otlp_metric_t))
+
+
+static ngx_http_accounting_exporter_t  *exporter;
+static ngx_queue_t                      exporter_queue;
+static size_t                           exporter_queued;
+static ngx_connection_t                *exporter_connection;
+static u_char                           exporter_status[16];
+static size_t                           exporter_status_len;
+static char                             exporter_hostname[NGX_HTTP_ACCOUNTING_EXPORTER_HOST_LEN];
+static ngx_http_accounting_exporter_request_t  *exporter_spare;
+static ngx_http_accounting_otlp_row_t  *exporter_rows;
+static uint64_t                        *exporter_values;
+static ngx_uint_t                       exporter_nr_rows;
+
+
+static void ngx_http_accounting_exporter_send(ngx_log_t *log);
+static void ngx_http_accounting_exporter_write_handler(ngx_event_t *wev);
+static void ngx_http_accounting_exporter_read_handler(ngx_event_t *rev);
+static void ngx_http_accounting_exporter_done(ngx_connection_t *c, ngx_int_t rc);
+static void ngx_http_accounting_exporter_dummy_handler(ngx_event_t *ev);
+static void ngx_http_accounting_exporter_free(ngx_http_accounting_exporter_request_t *req);
+
+
+// http_accounting_otlp http://HOST[:PORT][/URI] [buffer=SIZE] [timeout=TIME];
+char *
+ngx_http_accounting_otlp(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_accounting_main_conf_t *amcf = conf;
+
+    u_char                          *p;
+    ssize_t                          size;
+    ngx_str_t                       *value, s;
+    ngx_url_t                        u;
+    ngx_uint_t                       i;
+    ngx_http_accounting_exporter_t  *exp;
+
+    if (amcf->exporter != NULL) {
+        return "is duplicate";
+    }
+
+    exp = ngx_pcalloc(cf->pool, sizeof(ngx_http_accounting_exporter_t));
+    if (exp == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    exp->buffer = NGX_HTTP_ACCOUNTING_EXPORTER_BUFFER;
+    exp->timeout = NGX_HTTP_ACCOUNTING_EXPORTER_TIMEOUT;
+
+    value = cf->args->elts;
+
+    if (ngx_strncmp(value[1].data, "http://", 7) != 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid collector URL \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_memzero(&u, sizeof(ngx_url_t));
+
+    u.url.len = value[1].len - 7;
+    u.url.data = value[1].data + 7;
+    u.default_port = NGX_HTTP_ACCOUNTING_EXPORTER_PORT;
+    u.uri_part = 1;
+
+    if (ngx_parse_url(cf->pool, &u) != NGX_OK) {
+        if (u.err) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "%s in collector URL \"%V\"", u.err, &value[1]);
+        }
+        return NGX_CONF_ERROR;
+    }
+
+    if (u.naddrs == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "no address for collector URL \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    exp->addr = &u.addrs[0];
+
+    p = ngx_pnalloc(cf->pool, u.host.len + sizeof(":65535"));
+    if (p == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    (void) ngx_sprintf(p, "%V:%d%Z", &u.host, (int) u.port);
+    exp->host = (char *) p;
+
+    if (u.uri.len == 0) {
+        ngx_str_set(&u.uri, NGX_HTTP_ACCOUNTING_EXPORTER_URI);
+    }
+
+    p = ngx_pnalloc(cf->pool, u.uri.len + 1);
+    if (p == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    (void) ngx_cpystrn(p, u.uri.data, u.uri.len + 1);
+    exp->uri = (char *) p;
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "buffer=", 7) == 0) {
+            s.len = value[i].len - 7;
+            s.data = value[i].data + 7;
+            size = ngx_parse_size(&s);
+            if (size <= 0) {
+                goto invalid;
+            }
+            exp->buffer = size;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "timeout=", 8) == 0) {
+            s.len = value[i].len - 8;
+            s.data = value[i].data + 8;
+            exp->timeout = ngx_parse_time(&s, 0);
+            if (exp->timeout == (ngx_msec_t) NGX_ERROR || exp->timeout == 0) {
+                goto invalid;
+            }
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    amcf->exporter = exp;
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+ngx_int_t
+ngx_http_accounting_exporter_init(ngx_cycle_t *cycle, ngx_http_accounting_exporter_t *exp)
+{
+    size_t      len;
+    ngx_uint_t  i;
+
+    exporter = exp;
+
+    for (i = 0; i < NGX_HTTP_ACCOUNTING_SIZE_BUCKETS - 1; i++) {
+        ngx_http_accounting_exporter_size_bounds[i] = (double) ((1ULL << i) - 1);
+    }
+
+    ngx_queue_init(&exporter_queue);
+    exporter_queued = 0;
+    exporter_connection = NULL;
+    exporter_spare = NULL;
+    exporter_rows = NULL;
+    exporter_values = NULL;
+    exporter_nr_rows = 0;
+
+    len = ngx_min(cycle->hostname.len, sizeof(exporter_hostname) - 1);
+    ngx_memcpy(exporter_hostname, cycle->hostname.data, len);
+    exporter_hostname[len] = '\0';
+
+    return NGX_OK;
+}
+
+
+/*
+ * Encodes the interval as one request and queues it. Requests are sent one
+ * after another, failed ones are retried after the next flush up to
+ * NGX_HTTP_ACCOUNTING_EXPORTER_ATTEMPTS times; once more than "buffer"
+ * bytes are queued the oldest ones are dropped. The rows, values and the
+ * last request sent are kept for the next interval, so that a worker
+ * exporting to a healthy collector does not allocate.
+ */
+void
+ngx_http_accounting_exporter_export(ngx_log_t *log, time_t from, time_t to,
+    ngx_http_accounting_stats_t **entries, ngx_uint_t n)
+{
+    size_t                                   hlen, blen, size;
+    uint64_t                                *v;
+    ngx_uint_t                               i, k, classes[10];
+    ngx_queue_t                             *q;
+    ngx_http_accounting_stats_t             *stats;
+    ngx_http_accounting_otlp_resource_t      resource;
+    ngx_http_accounting_exporter_request_t  *req;
+    char                                     header[NGX_HTTP_ACCOUNTING_EXPORTER_HEADER];
+
+    if (n == 0) {
+        goto send;
+    }
+
+    if (n > exporter_nr_rows) {
+        if (exporter_rows) {
+            ngx_free(exporter_rows);
+            ngx_free(exporter_values);
+        }
+
+        exporter_nr_rows = 0;
+
+        exporter_rows = ngx_alloc(n * sizeof(ngx_http_accounting_otlp_row_t), log);
+        exporter_values = ngx_alloc(n * NGX_HTTP_ACCOUNTING_EXPORTER_VALUES * sizeof(uint64_t),
+                                    log);
+
+        if (exporter_rows == NULL || exporter_values == NULL) {
+            if (exporter_rows) {
+                ngx_free(exporter_rows);
+                exporter_rows = NULL;
+            }
+            if (exporter_values) {
+                ngx_free(exporter_values);
+                exporter_values = NULL;
+            }
+            goto send;
+        }
+
+        exporter_nr_rows = n;
+    }
+
+    for (i = 0; i < n; i++) {
+        stats = entries[i];
+        v = exporter_values + i * NGX_HTTP_ACCOUNTING_EXPORTER_VALUES;
+
+        ngx_http_accounting_stats_status_classes(stats, classes);
+
+        v[0] = stats->nr_requests;
+        v[1] = stats->bytes_in;
+        v[2] = stats->bytes_out;
+        v[3] = stats->total_latency_ms;
+        v[4] = stats->upstream_total_latency_ms;
+        v[5] = stats->upstream_attempts;
+        v[6] = stats->upstream_retries;
+        v[7] = stats->upstream_errors;
+        v[8] = classes[1];
+        v[9] = classes[2];
+        v[10] = classes[3];
+        v[11] = classes[4];
+        v[12] = classes[5];
+        v[13] = classes[9];
+        v[14] = stats->in_flight;
+        v[15] = stats->max_in_flight;
+        v[16] = stats->cpu_ns;
+
+        for (k = 0; k < NGX_HTTP_ACCOUNTING_SIZE_BUCKETS; k++) {
+            v[17 + k] = stats->size_in[k];
+            v[17 + NGX_HTTP_ACCOUNTING_SIZE_BUCKETS + k] = stats->size_out[k];
+        }
+
+        exporter_rows[i].id = stats->name.data;
+        exporter_rows[i].id_len = stats->name.len;
+        exporter_rows[i].level = stats->level;
+        exporter_rows[i].values = v;
+    }
+
+    resource.service = "nginx";
+    resource.host = exporter_hostname;
+    resource.pid = ngx_getpid();
+    resource.from_ns = (uint64_t) from * 1000000000;
+    resource.to_ns = (uint64_t) to * 1000000000;
+
+    // the body goes right after room for the header, which needs its length
+    req = exporter_spare;
+    exporter_spare = NULL;
+
+    size = req ? req->size - NGX_HTTP_ACCOUNTING_EXPORTER_HEADER : 0;
+
+    blen = ngx_http_accounting_otlp_encode(req ? req->data + NGX_HTTP_ACCOUNTING_EXPORTER_HEADER
+                                               : NULL,
+                                           size, &resource, ngx_http_accounting_exporter_metrics,
+                                           NGX_HTTP_ACCOUNTING_EXPORTER_NR_METRICS,
+                                           exporter_rows, n);
+    hlen = ngx_http_accounting_otlp_request(header, sizeof(header), exporter->host, exporter->uri,
+                                            blen);
+
+    if (blen == (size_t) -1 || hlen == 0 || hlen + blen > exporter->buffer) {
+        ngx_log_error(NGX_LOG_ERR, log, 0, "accounting interval too large to export");
+        exporter_spare = req;
+        goto send;
+    }
+
+    if (blen > size) {
+        if (req) {
+            ngx_free(req);
+        }
+
+        size = NGX_HTTP_ACCOUNTING_EXPORTER_HEADER + blen;
+
+        req = ngx_alloc(sizeof(ngx_http_accounting_exporter_request_t) + size, log);
+        if (req == NULL) {
+            goto send;
+        }
+
+        req->size = size;
+
+        (void) ngx_http_accounting_otlp_encode(req->data + NGX_HTTP_ACCOUNTING_EXPORTER_HEADER, blen,
+                                               &resource, ngx_http_accounting_exporter_metrics,
+                                               NGX_HTTP_ACCOUNTING_EXPORTER_NR_METRICS,
+                                               exporter_rows, n);
+    }
+
+    req->start = req->data + NGX_HTTP_ACCOUNTING_EXPORTER_HEADER - hlen;
+    req->len = hlen + blen;
+    req->sent = 0;
+    req->attempts = 0;
+
+    ngx_memcpy(req->start, header, hlen);
+
+    ngx_queue_insert_tail(&exporter_queue, &req->queue);
+    exporter_queued += req->len;
+
+    // drop the oldest requests, except for the one being sent
+    while (exporter_queued > exporter->buffer) {
+        q = ngx_queue_head(&exporter_queue);
+        req = ngx_queue_data(q, ngx_http_accounting_exporter_request_t, queue);
+
+        if (exporter_connection != NULL) {
+            q = ngx_queue_next(q);
+            req = ngx_queue_data(q, ngx_http_accounting_exporter_request_t, queue);
+        }
+
+        ngx_log_error(NGX_LOG_WARN, log, 0, "accounting export buffer full, dropping an interval");
+
+        ngx_queue_remove(&req->queue);
+        exporter_queued -= req->len;
+        ngx_http_accounting_exporter_free(req);
+    }
+
+send:
+
+    if (exporter_connection == NULL && !ngx_queue_empty(&exporter_queue) && !ngx_exiting) {
+        ngx_http_accounting_exporter_send(log);
+    }
+}
+
+
+// keeps the largest request done with for the next interval
+static void
+ngx_http_accounting_exporter_free(ngx_http_accounting_exporter_request_t *req)
+{
+    if (exporter_spare == NULL) {
+        exporter_spare = req;
+        return;
+    }
+
+    if (req->size > exporter_spare->size) {
+        ngx_free(exporter_spare);
+        exporter_spare = req;
+        return;
+    }
+
+    ngx_free(req);
+}
+
+
+static void
+ngx_http_accounting_exporter_send(ngx_log_t *log)
+{
+    ngx_int_t               rc;
+    ngx_connection_t       *c;
+    ngx_peer_connection_t   pc;
+
+    ngx_memzero(&pc, sizeof(ngx_peer_connection_t));
+
+    pc.sockaddr = exporter->addr->sockaddr;
+    pc.socklen = exporter->addr->socklen;
+    pc.name = &exporter->addr->name;
+    pc.get = ngx_event_get_peer;
+    pc.log = log;
+    pc.log_error = NGX_ERROR_ERR;
+
+    rc = ngx_event_connect_peer(&pc);
+
+    if (rc == NGX_ERROR || rc == NGX_BUSY || rc == NGX_DECLINED) {
+        if (pc.connection) {
+            ngx_close_connection(pc.connection);
+        }
+        return;
+    }
+
+    c = pc.connection;
+    c->data = NULL;
+    c->pool = NULL;
+    c->log = log;
+    c->read->log = log;
+    c->write->log = log;
+
+    c->write->handler = ngx_http_accounting_exporter_write_handler;
+    c->read->handler = ngx_http_accounting_exporter_read_handler;
+
+    exporter_connection = c;
+    exporter_status_len = 0;
+
+    if (rc == NGX_AGAIN) {
+        ngx_add_timer(c->write, exporter->timeout);
+        return;
+    }
+
+    ngx_http_accounting_exporter_write_handler(c->write);
+}
+
+
+static void
+ngx_http_accounting_exporter_write_handler(ngx_event_t *wev)
+{
+    ssize_t                                  n;
+    ngx_connection_t                        *c;
+    ngx_http_accounting_exporter_request_t  *req;
+
+    c = wev->data;
+
+    if (wev->timedout) {
+        ngx_log_error(NGX_LOG_ERR, c->log, NGX_ETIMEDOUT, "accounting collector timed out");
+        ngx_http_accounting_exporter_done(c, NGX_ERROR);
+        return;
+    }
+
+    req = ngx_queue_data(ngx_queue_head(&exporter_queue), ngx_http_accounting_exporter_request_t,
+                         queue);
+
+    while (req->sent < req->len) {
+        n = c->send(c, req->start + req->sent, req->len - req->sent);
+
+        if (n == NGX_AGAIN) {
+            ngx_add_timer(wev, exporter->timeout);
+
+            if (ngx_handle_write_event(wev, 0) != NGX_OK) {
+                ngx_http_accounting_exporter_done(c, NGX_ERROR);
+            }
+            return;
+        }
+
+        if (n == NGX_ERROR) {
+            ngx_http_accounting_exporter_done(c, NGX_ERROR);
+            return;
+        }
+
+        req->sent += n;
+    }
+
+    if (wev->timer_set) {
+        ngx_del_timer(wev);
+    }
+
+    wev->handler = ngx_http_accounting_exporter_dummy_handler;
+
+    ngx_add_timer(c->read, exporter->timeout);
+
+    if (ngx_handle_read_event(c->read, 0) != NGX_OK) {
+        ngx_http_accounting_exporter_done(c, NGX_ERROR);
+    }
+}
+
+
+static void
+ngx_http_accounting_exporter_read_handler(ngx_event_t *rev)
+{
+    ssize_t            n;
+    ngx_int_t          status;
+    ngx_connection_t  *c;
+
+    c = rev->data;
+
+    if (rev->timedout) {
+        ngx_log_error(NGX_LOG_ERR, c->log, NGX_ETIMEDOUT, "accounting collector timed out");
+        ngx_http_accounting_exporter_done(c, NGX_ERROR);
+        return;
+    }
+
+    // only the status line matters, "HTTP/1.1 200"
+    while (exporter_status_len < 12) {
+        n = c->recv(c, exporter_status + exporter_status_len,
+                    sizeof(exporter_status) - exporter_status_len);
+
+        if (n == NGX_AGAIN) {
+            if (ngx_handle_read_event(rev, 0) != NGX_OK) {
+                ngx_http_accounting_exporter_done(c, NGX_ERROR);
+            }
+            return;
+        }
+
+        if (n == NGX_ERROR || n == 0) {
+            ngx_http_accounting_exporter_done(c, NGX_ERROR);
+            return;
+        }
+
+        exporter_status_len += n;
+    }
+
+    if (ngx_strncmp(exporter_status, "HTTP/1.", 7) != 0) {
+        ngx_log_error(NGX_LOG_ERR, c->log, 0, "accounting collector sent an invalid response");
+        ngx_http_accounting_exporter_done(c, NGX_ERROR);
+        return;
+    }
+
+    status = ngx_atoi(exporter_status + 9, 3);
+
+    if (status >= 200 && status < 300) {
+        ngx_http_accounting_exporter_done(c, NGX_OK);
+        return;
+    }
+
+    ngx_log_error(NGX_LOG_ERR, c->log, 0, "accounting collector answered %i", status);
+
+    // the collector will not take it any better later on
+    if (status >= 400 && status < 500 && status != NGX_HTTP_REQUEST_TIME_OUT
+        && status != NGX_HTTP_TOO_MANY_REQUESTS)
+    {
+        ngx_http_accounting_exporter_done(c, NGX_DECLINED);
+        return;
+    }
+
+    ngx_http_accounting_exporter_done(c, NGX_ERROR);
+}
+
+
+/*
+ * NGX_OK and NGX_DECLINED are done with the request, NGX_ERROR retries it
+ * after the next flush, unless it failed too often: a collector that keeps
+ * failing the oldest request would otherwise hold back the later ones.
+ */
+static void
+ngx_http_accounting_exporter_done(ngx_connection_t *c, ngx_int_t rc)
+{
+    ngx_log_t                               *log;
+    ngx_queue_t                             *q;
+    ngx_http_accounting_exporter_request_t  *req;
+
+    log = c->log;
+
+    ngx_close_connection(c);
+    exporter_connection = NULL;
+
+    q = ngx_queue_head(&exporter_queue);
+    req = ngx_queue_data(q, ngx_http_accounting_exporter_request_t, queue);
+
+    if (rc == NGX_ERROR) {
+        req->sent = 0;
+
+        if (++req->attempts < NGX_HTTP_ACCOUNTING_EXPORTER_ATTEMPTS) {
+            return;
+        }
+
+        ngx_log_error(NGX_LOG_WARN, log, 0,
+                      "accounting export failed %d times, dropping an interval",
+                      NGX_HTTP_ACCOUNTING_EXPORTER_ATTEMPTS);
+    }
+
+    ngx_queue_remove(q);
+    exporter_queued -= req->len;
+    ngx_http_accounting_exporter_free(req);
+
+    if (!ngx_queue_empty(&exporter_queue) && !ngx_exiting) {
+        ngx_http_accounting_exporter_send(log);
+    }
+}
+
+
+static void
+ngx_http_accounting_exporter_dummy_handler(ngx_event_t *ev)
+{
+}
@@ -0,0 +1,26 @@
+#ifndef _NGX_HTTP_ACCOUNTING_EXPORTER_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_EXPORTER_H_INCLUDED_
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+#include "ngx_http_accounting_common.h"
+
+
+typedef struct {
+    ngx_addr_t      *addr;
+    char            *host;          /* Host header, NUL terminated */
+    char            *uri;
+    size_t           buffer;        /* bytes of requests kept for retries */
+    ngx_msec_t       timeout;
+} ngx_http_accounting_exporter_t;
+
+
+char *ngx_http_accounting_otlp(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+
+ngx_int_t ngx_http_accounting_exporter_init(ngx_cycle_t *cycle,
+                ngx_http_accounting_exporter_t *exporter);
+void ngx_http_accounting_exporter_export(ngx_log_t *log, time_t from, time_t to,
+                ngx_http_accounting_stats_t **entries, ngx_uint_t n);
+
+#endif /* _NGX_HTTP_ACCOUNTING_EXPORTER_H_INCLUDED_ */
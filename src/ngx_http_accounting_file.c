@@ -0,0 +1,166 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_module.h"
+#include "ngx_http_accounting_file.h"
+
+
+#define NGX_HTTP_ACCOUNTING_FILE_BUFFER         (256 * 1024)
+
+// a whole record always fits into an empty buffer
+#define NGX_HTTP_ACCOUNTING_FILE_MIN_BUFFER     4096
+
+
+static ngx_http_accounting_file_t    *file;
+static u_char                        *file_buffer;
+static u_char                        *file_pos;
+static ngx_http_accounting_record_t   file_record;
+
+
+// http_accounting_log path [format=tsv|json] [buffer=size]
+char *
+ngx_http_accounting_log_file(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_accounting_main_conf_t *amcf = conf;
+
+    ssize_t                      size;
+    ngx_str_t                   *value, s;
+    ngx_uint_t                   i;
+    ngx_http_accounting_file_t  *f;
+
+    if (amcf->file != NULL) {
+        return "is duplicate";
+    }
+
+    f = ngx_pcalloc(cf->pool, sizeof(ngx_http_accounting_file_t));
+    if (f == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    f->format = NGX_HTTP_ACCOUNTING_RECORD_TSV;
+    f->buffer = NGX_HTTP_ACCOUNTING_FILE_BUFFER;
+
+    value = cf->args->elts;
+
+    f->file = ngx_conf_open_file(cf->cycle, &value[1]);
+    if (f->file == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strcmp(value[i].data, "format=tsv") == 0) {
+            f->format = NGX_HTTP_ACCOUNTING_RECORD_TSV;
+            continue;
+        }
+
+        if (ngx_strcmp(value[i].data, "format=json") == 0) {
+            f->format = NGX_HTTP_ACCOUNTING_RECORD_JSON;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "buffer=", 7) == 0) {
+            s.len = value[i].len - 7;
+            s.data = value[i].data + 7;
+            size = ngx_parse_size(&s);
+            if (size < NGX_HTTP_ACCOUNTING_FILE_MIN_BUFFER) {
+                goto invalid;
+            }
+            f->buffer = size;
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    amcf->file = f;
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+ngx_int_t
+ngx_http_accounting_file_init(ngx_cycle_t *cycle, ngx_http_accounting_file_t *f)
+{
+    file = f;
+
+    file_buffer = ngx_alloc(f->buffer, cycle->log);
+    if (file_buffer == NULL) {
+        return NGX_ERROR;
+    }
+
+    file_pos = file_buffer;
+
+    return NGX_OK;
+}
+
+
+// starts a record in the free part of the buffer
+ngx_http_accounting_record_t *
+ngx_http_accounting_file_record(void)
+{
+    ngx_http_accounting_record_begin(&file_record, (char *) file_pos,
+                                     file->buffer - (file_pos - file_buffer), file->format);
+
+    return &file_record;
+}
+
+
+/*
+ * Keeps the record. One that did not fit is dropped and the buffer is
+ * written out, NGX_AGAIN tells to write the record once more.
+ */
+ngx_int_t
+ngx_http_accounting_file_commit(ngx_log_t *log)
+{
+    size_t  len;
+
+    len = ngx_http_accounting_record_end(&file_record);
+
+    if (file_record.full && file_pos != file_buffer) {
+        ngx_http_accounting_file_flush(log);
+        return NGX_AGAIN;
+    }
+
+    file_pos += len;
+
+    return NGX_OK;
+}
+
+
+/*
+ * One write per flush, normally once per interval. The descriptor is opened
+ * with O_APPEND, so workers sharing the file append whole buffers, and read
+ * at every flush, so a reopen after USR1 is picked up by the next interval.
+ */
+void
+ngx_http_accounting_file_flush(ngx_log_t *log)
+{
+    u_char   *p;
+    ssize_t   n;
+
+    for (p = file_buffer; p < file_pos; p += n) {
+        n = ngx_write_fd(file->file->fd, p, file_pos - p);
+
+        if (n == -1 && ngx_errno == NGX_EINTR) {
+            n = 0;
+            continue;
+        }
+
+        if (n <= 0) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                          ngx_write_fd_n " to \"%V\" failed, %uz bytes of accounting lost",
+                          &file->file->name, (size_t) (file_pos - p));
+            break;
+        }
+    }
+
+    file_pos = file_buffer;
+}
@@ -0,0 +1,24 @@
+#ifndef _NGX_HTTP_ACCOUNTING_FILE_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_FILE_H_INCLUDED_
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+#include "ngx_http_accounting_record.h"
+
+
+typedef struct {
+    ngx_open_file_t  *file;         /* reopened by nginx on USR1 */
+    ngx_uint_t        format;       /* NGX_HTTP_ACCOUNTING_RECORD_TSV or _JSON */
+    size_t            buffer;
+} ngx_http_accounting_file_t;
+
+
+char *ngx_http_accounting_log_file(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+
+ngx_int_t ngx_http_accounting_file_init(ngx_cycle_t *cycle, ngx_http_accounting_file_t *file);
+ngx_http_accounting_record_t *ngx_http_accounting_file_record(void);
+ngx_int_t ngx_http_accounting_file_commit(ngx_log_t *log);
+void ngx_http_accounting_file_flush(ngx_log_t *log);
+
+#endif /* _NGX_HTTP_ACCOUNTING_FILE_H_INCLUDED_ */
@@ -6,7 +6,7 @@
 
 typedef struct {
     void             *value;
-    u_char            len;
+    size_t            len;
     u_char           *name;
 } ngx_http_accounting_hash_elt_t;
 
@@ -0,0 +1,632 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_module.h"
+#include "ngx_http_accounting_history.h"
+
+
+#define NGX_HTTP_ACCOUNTING_HISTORY_CHUNK   16384
+
+// maximum length of one line of the status output, besides the id
+#define NGX_HTTP_ACCOUNTING_HISTORY_LINE                                          \
+    (sizeof("||||||||" CRLF) - 1 + 2 * NGX_TIME_T_LEN + 6 * NGX_ATOMIC_T_LEN)
+
+/*
+ * The zone holds one chunk: this header, an open addressing index of the
+ * ids, the ids and, per id, the rings of all tiers one after another. Ids
+ * are only ever added, a worker looks its ids up once and caches the slot.
+ */
+typedef struct {
+    ngx_uint_t       max_ids;
+    ngx_uint_t       nr_tiers;
+    ngx_uint_t       nr_points;
+    ngx_http_accounting_history_tier_t  tiers[NGX_HTTP_ACCOUNTING_HISTORY_MAX_TIERS];
+
+    ngx_uint_t       nr_ids;
+    ngx_uint_t       index_mask;
+    uint32_t        *index;         /* slot of the id + 1, 0 is empty */
+    ngx_http_accounting_history_id_t     *ids;
+    ngx_http_accounting_history_point_t  *points;
+} ngx_http_accounting_history_sh_t;
+
+
+static ngx_str_t  ngx_http_accounting_history_zone_name = ngx_string("http_accounting_history");
+
+static ngx_str_t  ngx_http_accounting_history_default_tiers = ngx_string("10s:1h,1m:24h,1h:30d");
+
+static char *ngx_http_accounting_history_parse_tiers(ngx_conf_t *cf,
+    ngx_http_accounting_history_t *history, ngx_str_t *value);
+static size_t ngx_http_accounting_history_size(ngx_http_accounting_history_t *history,
+    ngx_uint_t *index_size);
+static ngx_int_t ngx_http_accounting_history_init_zone(ngx_shm_zone_t *shm_zone, void *data);
+static ngx_uint_t ngx_http_accounting_history_find(ngx_http_accounting_history_t *history,
+    ngx_http_accounting_stats_t *stats);
+static ngx_int_t ngx_http_accounting_status_handler(ngx_http_request_t *r);
+static ngx_int_t ngx_http_accounting_status_time(ngx_str_t *value, time_t now, time_t *time);
+
+
+// http_accounting_history max_ids=N [tiers=STEP:SPAN,...];
+char *
+ngx_http_accounting_history(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_accounting_main_conf_t *amcf = conf;
+
+    char                           *rv;
+    ngx_str_t                      *value, s;
+    ngx_int_t                       n;
+    ngx_uint_t                      i;
+    ngx_http_accounting_history_t  *history;
+
+    if (amcf->history != NULL) {
+        return "is duplicate";
+    }
+
+    history = ngx_pcalloc(cf->pool, sizeof(ngx_http_accounting_history_t));
+    if (history == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    value = cf->args->elts;
+    s = ngx_http_accounting_history_default_tiers;
+
+    for (i = 1; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "max_ids=", 8) == 0) {
+            n = ngx_atoi(value[i].data + 8, value[i].len - 8);
+            if (n <= 0 || n > 0x7fffffff) {
+                goto invalid;
+            }
+            history->max_ids = n;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "tiers=", 6) == 0) {
+            s.len = value[i].len - 6;
+            s.data = value[i].data + 6;
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    if (history->max_ids == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"max_ids\" must be set");
+        return NGX_CONF_ERROR;
+    }
+
+    rv = ngx_http_accounting_history_parse_tiers(cf, history, &s);
+    if (rv != NGX_CONF_OK) {
+        return rv;
+    }
+
+    amcf->history = history;
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+// "10s:1h,1m:24h", finest tier first
+static char *
+ngx_http_accounting_history_parse_tiers(ngx_conf_t *cf, ngx_http_accounting_history_t *history,
+    ngx_str_t *value)
+{
+    u_char                              *p, *last, *colon, *comma;
+    ngx_str_t                            s;
+    ngx_http_accounting_history_tier_t  *tier;
+
+    p = value->data;
+    last = value->data + value->len;
+
+    while (p < last) {
+        comma = ngx_strlchr(p, last, ',');
+        if (comma == NULL) {
+            comma = last;
+        }
+
+        colon = ngx_strlchr(p, comma, ':');
+        if (colon == NULL) {
+            goto invalid;
+        }
+
+        if (history->nr_tiers == NGX_HTTP_ACCOUNTING_HISTORY_MAX_TIERS) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "too many history tiers, at most %d",
+                               NGX_HTTP_ACCOUNTING_HISTORY_MAX_TIERS);
+            return NGX_CONF_ERROR;
+        }
+
+        tier = &history->tiers[history->nr_tiers];
+
+        s.data = p;
+        s.len = colon - p;
+        tier->step = ngx_parse_time(&s, 1);
+
+        s.data = colon + 1;
+        s.len = comma - colon - 1;
+        tier->span = ngx_parse_time(&s, 1);
+
+        if (tier->step == (time_t) NGX_ERROR || tier->step == 0
+            || tier->span == (time_t) NGX_ERROR || tier->span < tier->step
+            || tier->span % tier->step)
+        {
+            goto invalid;
+        }
+
+        if (history->nr_tiers && tier->step <= history->tiers[history->nr_tiers - 1].step) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                               "history tiers must be ordered from the finest step");
+            return NGX_CONF_ERROR;
+        }
+
+        tier->nr_points = tier->span / tier->step;
+        tier->offset = history->nr_points;
+
+        history->nr_points += tier->nr_points;
+        history->nr_tiers++;
+
+        p = comma + 1;
+    }
+
+    if (history->nr_tiers == 0) {
+        goto invalid;
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid history tiers \"%V\"", value);
+
+    return NGX_CONF_ERROR;
+}
+
+
+// http_accounting_status;
+char *
+ngx_http_accounting_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_core_loc_conf_t         *clcf;
+    ngx_http_accounting_main_conf_t  *amcf;
+
+    clcf = ngx_http_conf_get_module_loc_conf(cf, ngx_http_core_module);
+    clcf->handler = ngx_http_accounting_status_handler;
+
+    amcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_accounting_module);
+    amcf->status = 1;
+
+    return NGX_CONF_OK;
+}
+
+
+static size_t
+ngx_http_accounting_history_size(ngx_http_accounting_history_t *history, ngx_uint_t *index_size)
+{
+    // at most half full, so that probing stays short
+    for (*index_size = 2; *index_size < 2 * history->max_ids; *index_size <<= 1) { /* void */ }
+
+    return ngx_align(sizeof(ngx_http_accounting_history_sh_t), 8)
+           + ngx_align(*index_size * sizeof(uint32_t), 8)
+           + history->max_ids * sizeof(ngx_http_accounting_history_id_t)
+           + history->max_ids * history->nr_points * sizeof(ngx_http_accounting_history_point_t);
+}
+
+
+ngx_int_t
+ngx_http_accounting_history_init_conf(ngx_conf_t *cf)
+{
+    size_t                            size;
+    ngx_uint_t                        index_size;
+    ngx_shm_zone_t                   *zone;
+    ngx_http_accounting_main_conf_t  *amcf;
+
+    amcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_accounting_module);
+
+    if (amcf->history == NULL) {
+        return NGX_OK;
+    }
+
+    size = ngx_http_accounting_history_size(amcf->history, &index_size);
+
+    // room for the slab pool bookkeeping of the pages the chunk spans
+    size += size / 64 + 8 * ngx_pagesize;
+
+    zone = ngx_shared_memory_add(cf, &ngx_http_accounting_history_zone_name, size,
+                                 &ngx_http_accounting_module);
+    if (zone == NULL) {
+        return NGX_ERROR;
+    }
+
+    zone->init = ngx_http_accounting_history_init_zone;
+    zone->data = amcf->history;
+
+    amcf->history->zone = zone;
+
+    return NGX_OK;
+}
+
+
+static ngx_int_t
+ngx_http_accounting_history_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    u_char                            *p;
+    size_t                             size;
+    ngx_uint_t                         index_size;
+    ngx_slab_pool_t                   *shpool;
+    ngx_http_accounting_history_t     *history = shm_zone->data;
+    ngx_http_accounting_history_sh_t  *sh, *osh = data;
+
+    shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+    if (osh) {
+        // reused across a reload: the history survives as long as its layout does
+        if (osh->max_ids == history->max_ids && osh->nr_tiers == history->nr_tiers
+            && ngx_memcmp(osh->tiers, history->tiers, sizeof(osh->tiers)) == 0)
+        {
+            shm_zone->data = osh;
+            return NGX_OK;
+        }
+
+        ngx_slab_free(shpool, osh);
+    }
+
+    size = ngx_http_accounting_history_size(history, &index_size);
+
+    p = ngx_slab_alloc(shpool, size);
+    if (p == NULL) {
+        return NGX_ERROR;
+    }
+
+    ngx_memzero(p, size);
+
+    sh = (ngx_http_accounting_history_sh_t *) p;
+    p += ngx_align(sizeof(ngx_http_accounting_history_sh_t), 8);
+
+    sh->max_ids = history->max_ids;
+    sh->nr_tiers = history->nr_tiers;
+    sh->nr_points = history->nr_points;
+    ngx_memcpy(sh->tiers, history->tiers, sizeof(sh->tiers));
+
+    sh->index_mask = index_size - 1;
+    sh->index = (uint32_t *) p;
+    p += ngx_align(index_size * sizeof(uint32_t), 8);
+
+    sh->ids = (ngx_http_accounting_history_id_t *) p;
+    p += history->max_ids * sizeof(ngx_http_accounting_history_id_t);
+
+    sh->points = (ngx_http_accounting_history_point_t *) p;
+
+    shm_zone->data = sh;
+
+    return NGX_OK;
+}
+
+
+// returns the slot of the id + 1, or NGX_HTTP_ACCOUNTING_HISTORY_NONE
+static ngx_uint_t
+ngx_http_accounting_history_find(ngx_http_accounting_history_t *history,
+    ngx_http_accounting_stats_t *stats)
+{
+    ngx_uint_t                         i, n;
+    ngx_slab_pool_t                   *shpool;
+    ngx_http_accounting_history_id_t  *id;
+    ngx_http_accounting_history_sh_t  *sh;
+
+    if (stats->name.len > NGX_HTTP_ACCOUNTING_HISTORY_NAME_LEN) {
+        return NGX_HTTP_ACCOUNTING_HISTORY_NONE;
+    }
+
+    sh = history->zone->data;
+    shpool = (ngx_slab_pool_t *) history->zone->shm.addr;
+
+    ngx_shmtx_lock(&shpool->mutex);
+
+    for (i = ngx_hash_key(stats->name.data, stats->name.len) & sh->index_mask;
+         sh->index[i];
+         i = (i + 1) & sh->index_mask)
+    {
+        id = &sh->ids[sh->index[i] - 1];
+
+        if (id->len == stats->name.len
+            && ngx_memcmp(id->name, stats->name.data, stats->name.len) == 0)
+        {
+            n = sh->index[i];
+            ngx_shmtx_unlock(&shpool->mutex);
+            return n;
+        }
+    }
+
+    if (sh->nr_ids == sh->max_ids) {
+        ngx_shmtx_unlock(&shpool->mutex);
+
+        ngx_log_error(NGX_LOG_WARN, ngx_cycle->log, 0,
+                      "accounting history is full, \"%V\" is not kept", &stats->name);
+        return NGX_HTTP_ACCOUNTING_HISTORY_NONE;
+    }
+
+    n = sh->nr_ids;
+
+    id = &sh->ids[n];
+    ngx_memcpy(id->name, stats->name.data, stats->name.len);
+    id->len = stats->name.len;
+    id->level = stats->level;
+
+    sh->index[i] = n + 1;
+
+    // the status handler reads the ids without the lock
+    ngx_memory_barrier();
+    sh->nr_ids = n + 1;
+
+    ngx_shmtx_unlock(&shpool->mutex);
+
+    return n + 1;
+}
+
+
+// adds one flushed interval, starting at time, to every tier
+void
+ngx_http_accounting_history_add(ngx_http_accounting_history_t *history,
+    ngx_http_accounting_stats_t *stats, time_t time)
+{
+    time_t                                start;
+    ngx_uint_t                            i, classes[10];
+    ngx_atomic_uint_t                     old;
+    ngx_http_accounting_history_sh_t     *sh;
+    ngx_http_accounting_history_tier_t   *tier;
+    ngx_http_accounting_history_point_t  *points, *point;
+
+    if (stats->history == 0) {
+        stats->history = ngx_http_accounting_history_find(history, stats);
+    }
+
+    if (stats->history == NGX_HTTP_ACCOUNTING_HISTORY_NONE) {
+        return;
+    }
+
+    sh = history->zone->data;
+    points = sh->points + (stats->history - 1) * sh->nr_points;
+
+    ngx_http_accounting_stats_status_classes(stats, classes);
+
+    for (i = 0; i < sh->nr_tiers; i++) {
+        tier = &sh->tiers[i];
+
+        start = time - time % tier->step;
+        point = &points[tier->offset + (time / tier->step) % tier->nr_points];
+
+        // the first worker to reach a new step resets the point; intervals
+        // racing with the reset may be lost
+        old = point->time;
+
+        if (old != (ngx_atomic_uint_t) start
+            && ngx_atomic_cmp_set(&point->time, old, (ngx_atomic_uint_t) start))
+        {
+            point->requests = 0;
+            point->bytes_in = 0;
+            point->bytes_out = 0;
+            point->latency_ms = 0;
+            point->status_4xx = 0;
+            point->status_5xx = 0;
+        }
+
+        (void) ngx_atomic_fetch_add(&point->requests, stats->nr_requests);
+        (void) ngx_atomic_fetch_add(&point->bytes_in, stats->bytes_in);
+        (void) ngx_atomic_fetch_add(&point->bytes_out, stats->bytes_out);
+        (void) ngx_atomic_fetch_add(&point->latency_ms, stats->total_latency_ms);
+        (void) ngx_atomic_fetch_add(&point->status_4xx, classes[4]);
+        (void) ngx_atomic_fetch_add(&point->status_5xx, classes[5]);
+    }
+}
+
+
+/*
+ * GET /status?id=ID&from=TIME&to=TIME, times are unix times or, with a
+ * leading '-', seconds before now. Answers one line per id and step:
+ *
+ *   id|from|to|requests|bytes_in|bytes_out|latency_ms|4xx|5xx
+ *
+ * from the finest tier that still reaches back to "from".
+ */
+static ngx_int_t
+ngx_http_accounting_status_handler(ngx_http_request_t *r)
+{
+    off_t                                 length;
+    time_t                                now, from, to, t, oldest;
+    ngx_int_t                             rc;
+    ngx_buf_t                            *b;
+    ngx_str_t                             value, filter;
+    ngx_uint_t                            i, nr_ids;
+    ngx_chain_t                          *out, **last;
+    ngx_http_accounting_history_t        *history;
+    ngx_http_accounting_history_sh_t     *sh;
+    ngx_http_accounting_history_id_t     *id;
+    ngx_http_accounting_history_tier_t   *tier;
+    ngx_http_accounting_history_point_t  *point;
+    ngx_http_accounting_main_conf_t      *amcf;
+    u_char                               *dst, *src;
+
+    if (!(r->method & (NGX_HTTP_GET|NGX_HTTP_HEAD))) {
+        return NGX_HTTP_NOT_ALLOWED;
+    }
+
+    rc = ngx_http_discard_request_body(r);
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    amcf = ngx_http_get_module_main_conf(r, ngx_http_accounting_module);
+    history = amcf->history;
+
+    if (history == NULL || history->zone == NULL) {
+        return NGX_HTTP_NOT_FOUND;
+    }
+
+    sh = history->zone->data;
+
+    now = ngx_time();
+    from = now - 3600;
+    to = now;
+
+    if (ngx_http_arg(r, (u_char *) "from", 4, &value) == NGX_OK
+        && ngx_http_accounting_status_time(&value, now, &from) != NGX_OK)
+    {
+        return NGX_HTTP_BAD_REQUEST;
+    }
+
+    if (ngx_http_arg(r, (u_char *) "to", 2, &value) == NGX_OK
+        && ngx_http_accounting_status_time(&value, now, &to) != NGX_OK)
+    {
+        return NGX_HTTP_BAD_REQUEST;
+    }
+
+    if (to > now) {
+        to = now;
+    }
+
+    ngx_str_null(&filter);
+
+    if (ngx_http_arg(r, (u_char *) "id", 2, &value) == NGX_OK) {
+        filter.data = ngx_pnalloc(r->pool, value.len);
+        if (filter.data == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        dst = filter.data;
+        src = value.data;
+        ngx_unescape_uri(&dst, &src, value.len, NGX_UNESCAPE_URI);
+        filter.len = dst - filter.data;
+    }
+
+    for (i = 0; i < sh->nr_tiers - 1; i++) {
+        if (sh->tiers[i].span >= now - from) {
+            break;
+        }
+    }
+
+    tier = &sh->tiers[i];
+
+    // older points of the tier have been overwritten already
+    oldest = now - now % tier->step - tier->span + tier->step;
+    if (from < oldest) {
+        from = oldest;
+    }
+
+    from -= from % tier->step;
+
+    nr_ids = sh->nr_ids;
+    ngx_memory_barrier();
+
+    out = NULL;
+    last = &out;
+    length = 0;
+    b = NULL;
+
+    for (i = 0; i < nr_ids; i++) {
+        id = &sh->ids[i];
+
+        if (filter.data
+            && (filter.len != id->len || ngx_memcmp(filter.data, id->name, id->len) != 0))
+        {
+            continue;
+        }
+
+        for (t = from; t <= to; t += tier->step) {
+            point = &sh->points[i * sh->nr_points + tier->offset
+                                + (t / tier->step) % tier->nr_points];
+
+            if (point->time != (ngx_atomic_uint_t) t) {
+                continue;
+            }
+
+            if (b == NULL
+                || (size_t) (b->end - b->last) < id->len + NGX_HTTP_ACCOUNTING_HISTORY_LINE)
+            {
+                b = ngx_create_temp_buf(r->pool, NGX_HTTP_ACCOUNTING_HISTORY_CHUNK);
+                if (b == NULL) {
+                    return NGX_HTTP_INTERNAL_SERVER_ERROR;
+                }
+
+                *last = ngx_alloc_chain_link(r->pool);
+                if (*last == NULL) {
+                    return NGX_HTTP_INTERNAL_SERVER_ERROR;
+                }
+
+                (*last)->buf = b;
+                (*last)->next = NULL;
+                last = &(*last)->next;
+            }
+
+            dst = b->last;
+
+            b->last = ngx_sprintf(b->last, "%*s|%T|%T|%uA|%uA|%uA|%uA|%uA|%uA" CRLF,
+                                  id->len, id->name, t, t + tier->step,
+                                  point->requests, point->bytes_in, point->bytes_out,
+                                  point->latency_ms / (point->requests ? point->requests : 1),
+                                  point->status_4xx, point->status_5xx);
+
+            length += b->last - dst;
+        }
+    }
+
+    if (b == NULL) {
+        b = ngx_calloc_buf(r->pool);
+        if (b == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        out = ngx_alloc_chain_link(r->pool);
+        if (out == NULL) {
+            return NGX_HTTP_INTERNAL_SERVER_ERROR;
+        }
+
+        out->buf = b;
+        out->next = NULL;
+    }
+
+    b->last_buf = (r == r->main) ? 1 : 0;
+    b->last_in_chain = 1;
+
+    ngx_str_set(&r->headers_out.content_type, "text/plain");
+    r->headers_out.content_type_len = r->headers_out.content_type.len;
+    r->headers_out.status = NGX_HTTP_OK;
+    r->headers_out.content_length_n = length;
+
+    rc = ngx_http_send_header(r);
+
+    if (rc == NGX_ERROR || rc > NGX_OK || r->header_only) {
+        return rc;
+    }
+
+    return ngx_http_output_filter(r, out);
+}
+
+
+static ngx_int_t
+ngx_http_accounting_status_time(ngx_str_t *value, time_t now, time_t *time)
+{
+    time_t  t;
+
+    if (value->len > 1 && value->data[0] == '-') {
+        t = ngx_atotm(value->data + 1, value->len - 1);
+        if (t == NGX_ERROR) {
+            return NGX_ERROR;
+        }
+
+        *time = now - t;
+        return NGX_OK;
+    }
+
+    t = ngx_atotm(value->data, value->len);
+    if (t == NGX_ERROR) {
+        return NGX_ERROR;
+    }
+
+    *time = t;
+    return NGX_OK;
+}
@@ -0,0 +1,57 @@
+#ifndef _NGX_HTTP_ACCOUNTING_HISTORY_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_HISTORY_H_INCLUDED_
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_module.h"
+
+
+#define NGX_HTTP_ACCOUNTING_HISTORY_MAX_TIERS   4
+#define NGX_HTTP_ACCOUNTING_HISTORY_NAME_LEN    128
+
+// stats->history of ids that did not fit into the zone
+#define NGX_HTTP_ACCOUNTING_HISTORY_NONE        ((ngx_uint_t) -1)
+
+// one interval of one id, shared between all workers and updated with atomics only
+typedef struct {
+    ngx_atomic_t     time;          /* start of the step, 0 if never written */
+    ngx_atomic_t     requests;
+    ngx_atomic_t     bytes_in;
+    ngx_atomic_t     bytes_out;
+    ngx_atomic_t     latency_ms;
+    ngx_atomic_t     status_4xx;
+    ngx_atomic_t     status_5xx;
+} ngx_http_accounting_history_point_t;
+
+typedef struct {
+    u_char           name[NGX_HTTP_ACCOUNTING_HISTORY_NAME_LEN];
+    ngx_uint_t       len;
+    ngx_uint_t       level;
+} ngx_http_accounting_history_id_t;
+
+typedef struct {
+    time_t           step;
+    time_t           span;
+    ngx_uint_t       nr_points;
+    ngx_uint_t       offset;        /* of the first point of the tier within an id */
+} ngx_http_accounting_history_tier_t;
+
+struct ngx_http_accounting_history_s {
+    ngx_uint_t       max_ids;
+    ngx_uint_t       nr_tiers;
+    ngx_uint_t       nr_points;     /* per id, all tiers */
+    ngx_http_accounting_history_tier_t  tiers[NGX_HTTP_ACCOUNTING_HISTORY_MAX_TIERS];
+    ngx_shm_zone_t  *zone;
+};
+
+char *ngx_http_accounting_history(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+char *ngx_http_accounting_status(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_accounting_history_init_conf(ngx_conf_t *cf);
+
+void ngx_http_accounting_history_add(ngx_http_accounting_history_t *history,
+                ngx_http_accounting_stats_t *stats, time_t time);
+
+#endif /* _NGX_HTTP_ACCOUNTING_HISTORY_H_INCLUDED_ */
@@ -0,0 +1,99 @@
+#include <math.h>
+#include <string.h>
+
+#include "ngx_http_accounting_hll.h"
+
+
+// MurmurHash64A, fixed seed so that sketches of all hosts can be merged
+uint64_t
+ngx_http_accounting_hll_hash(const void *data, size_t len)
+{
+    const uint64_t        m = 0xc6a4a7935bd1e995ULL;
+    const int             r = 47;
+    const unsigned char  *p = data;
+    const unsigned char  *end = p + (len & ~(size_t) 7);
+    uint64_t              h = 0x8445d61a4e774912ULL ^ (len * m);
+    uint64_t              k;
+
+    while (p != end) {
+        memcpy(&k, p, sizeof(k));
+        p += 8;
+
+        k *= m;
+        k ^= k >> r;
+        k *= m;
+
+        h ^= k;
+        h *= m;
+    }
+
+    switch (len & 7) {
+    case 7: h ^= (uint64_t) p[6] << 48; /* fall through */
+    case 6: h ^= (uint64_t) p[5] << 40; /* fall through */
+    case 5: h ^= (uint64_t) p[4] << 32; /* fall through */
+    case 4: h ^= (uint64_t) p[3] << 24; /* fall through */
+    case 3: h ^= (uint64_t) p[2] << 16; /* fall through */
+    case 2: h ^= (uint64_t) p[1] << 8;  /* fall through */
+    case 1: h ^= (uint64_t) p[0];
+            h *= m;
+    }
+
+    h ^= h >> r;
+    h *= m;
+    h ^= h >> r;
+
+    return h;
+}
+
+
+uint64_t
+ngx_http_accounting_hll_estimate(const uint8_t *registers, unsigned precision)
+{
+    size_t  i, m, zeros;
+    double  sum, alpha, estimate;
+
+    m = (size_t) 1 << precision;
+    zeros = 0;
+    sum = 0;
+
+    for (i = 0; i < m; i++) {
+        sum += ldexp(1.0, -registers[i]);
+        zeros += registers[i] == 0;
+    }
+
+    switch (m) {
+    case 16:
+        alpha = 0.673;
+        break;
+    case 32:
+        alpha = 0.697;
+        break;
+    case 64:
+        alpha = 0.709;
+        break;
+    default:
+        alpha = 0.7213 / (1.0 + 1.079 / m);
+    }
+
+    estimate = alpha * m * m / sum;
+
+    // small range correction, linear counting is more precise here
+    if (estimate <= 2.5 * m && zeros) {
+        estimate = m * log((double) m / zeros);
+    }
+
+    return (uint64_t) (estimate + 0.5);
+}
+
+
+void
+ngx_http_accounting_hll_merge(uint8_t *dst, const uint8_t *src, unsigned precision)
+{
+    size_t  i;
+
+    for (i = 0; i < ((size_t) 1 << precision); i++) {
+        if (src[i] > dst[i]) {
+            dst[i] = src[i];
+        }
+    }
+}
@@ -0,0 +1,37 @@
+#ifndef _NGX_HTTP_ACCOUNTING_HLL_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_HLL_H_INCLUDED_
+
+/*
+ * HyperLogLog sketches with one byte per register, 2^precision registers.
+ * Only depends on libc, so the tools can merge and estimate them as well.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define NGX_HTTP_ACCOUNTING_HLL_MIN_PRECISION   4
+#define NGX_HTTP_ACCOUNTING_HLL_MAX_PRECISION   16
+
+
+uint64_t ngx_http_accounting_hll_hash(const void *data, size_t len);
+uint64_t ngx_http_accounting_hll_estimate(const uint8_t *registers, unsigned precision);
+void ngx_http_accounting_hll_merge(uint8_t *dst, const uint8_t *src, unsigned precision);
+
+
+static inline void
+ngx_http_accounting_hll_add(uint8_t *registers, unsigned precision, uint64_t hash)
+{
+    uint8_t   rank;
+    uint64_t  w;
+
+    // the bit below the index bits terminates the run of zeros
+    w = (hash << precision) | ((uint64_t) 1 << (precision - 1));
+    rank = (uint8_t) __builtin_clzll(w) + 1;
+
+    if (rank > registers[hash >> (64 - precision)]) {
+        registers[hash >> (64 - precision)] = rank;
+    }
+}
+
+#endif /* _NGX_HTTP_ACCOUNTING_HLL_H_INCLUDED_ */
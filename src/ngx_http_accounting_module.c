@@ -5,6 +5,11 @@
 #include "ngx_http_accounting_hash.h"
 #include "ngx_http_accounting_common.h"
 #include "ngx_http_accounting_module.h"
+#include "ngx_http_accounting_quota.h"
+#include "ngx_http_accounting_slo.h"
+#include "ngx_http_accounting_history.h"
+#include "ngx_http_accounting_hll.h"
+#include "ngx_http_accounting_cpu.h"
 #include "ngx_http_accounting_status_code.h"
 #include "ngx_http_accounting_worker_process.h"
 
@@ -17,10 +22,26 @@ static void ngx_http_accounting_process_exit(ngx_cycle_t *cycle);
 static void *ngx_http_accounting_create_main_conf(ngx_conf_t *cf);
 static char *ngx_http_accounting_init_main_conf(ngx_conf_t *cf, void *conf);
 
+static char *ngx_http_accounting_depth_caps(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+static char *ngx_http_accounting_distinct(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+
 static void *ngx_http_accounting_create_loc_conf(ngx_conf_t *cf);
 static char *ngx_http_accounting_merge_loc_conf(ngx_conf_t *cf, void *parent, void *child);
 
 
+static ngx_conf_num_bounds_t  ngx_http_accounting_sampling_bounds = {
+    ngx_conf_check_num_bounds, 0, -1
+};
+
+
+static ngx_conf_enum_t  ngx_http_accounting_cpu_modes[] = {
+    { ngx_string("off"), NGX_HTTP_ACCOUNTING_CPU_OFF },
+    { ngx_string("thread"), NGX_HTTP_ACCOUNTING_CPU_THREAD },
+    { ngx_string("tsc"), NGX_HTTP_ACCOUNTING_CPU_TSC },
+    { ngx_null_string, 0 }
+};
+
+
 static ngx_command_t  ngx_http_accounting_commands[] = {
     { ngx_string("http_accounting"),
       NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
@@ -36,6 +57,76 @@ static ngx_command_t  ngx_http_accounting_commands[] = {
       offsetof(ngx_http_accounting_main_conf_t, interval),
       NULL},
 
+    { ngx_string("http_accounting_sampling"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_accounting_main_conf_t, sampling),
+      &ngx_http_accounting_sampling_bounds},
+
+    { ngx_string("http_accounting_progressive"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_accounting_main_conf_t, progressive),
+      NULL},
+
+    { ngx_string("http_accounting_concurrency"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_accounting_main_conf_t, concurrency),
+      NULL},
+
+    { ngx_string("http_accounting_cpu"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_enum_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_accounting_main_conf_t, cpu),
+      &ngx_http_accounting_cpu_modes},
+
+    { ngx_string("http_accounting_top"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_accounting_main_conf_t, top),
+      NULL},
+
+    { ngx_string("http_accounting_depth"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_num_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_accounting_main_conf_t, depth),
+      NULL},
+
+    { ngx_string("http_accounting_depth_caps"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_accounting_depth_caps,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL},
+
+    { ngx_string("http_accounting_snapshot"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE1,
+      ngx_conf_set_str_slot,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      offsetof(ngx_http_accounting_main_conf_t, snapshot_path),
+      NULL},
+
+    { ngx_string("http_accounting_distinct"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE12,
+      ngx_http_accounting_distinct,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL},
+
+    { ngx_string("http_accounting_registry"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE12,
+      ngx_http_accounting_registry,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL},
+
     { ngx_string("http_accounting_id"),
       NGX_HTTP_MAIN_CONF|NGX_HTTP_SRV_CONF|NGX_HTTP_LOC_CONF|NGX_CONF_TAKE1,
       ngx_conf_set_str_slot,
@@ -43,6 +134,48 @@ static ngx_command_t  ngx_http_accounting_commands[] = {
       offsetof(ngx_http_accounting_loc_conf_t, accounting_id),
       NULL},
 
+    { ngx_string("http_accounting_quota"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_2MORE,
+      ngx_http_accounting_quota,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL},
+
+    { ngx_string("http_accounting_slo"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_2MORE,
+      ngx_http_accounting_slo,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL},
+
+    { ngx_string("http_accounting_otlp"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_1MORE,
+      ngx_http_accounting_otlp,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL},
+
+    { ngx_string("http_accounting_log"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE123,
+      ngx_http_accounting_log_file,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL},
+
+    { ngx_string("http_accounting_history"),
+      NGX_HTTP_MAIN_CONF|NGX_CONF_TAKE12,
+      ngx_http_accounting_history,
+      NGX_HTTP_MAIN_CONF_OFFSET,
+      0,
+      NULL},
+
+    { ngx_string("http_accounting_status"),
+      NGX_HTTP_LOC_CONF|NGX_CONF_NOARGS,
+      ngx_http_accounting_status,
+      0,
+      0,
+      NULL},
+
     ngx_null_command
 };
 
@@ -96,6 +229,33 @@ ngx_http_accounting_init(ngx_conf_t *cf)
 
     *h = ngx_http_accounting_handler;
 
+    if (amcf->quotas != NULL || amcf->progressive || amcf->concurrency
+        || amcf->cpu != NGX_HTTP_ACCOUNTING_CPU_OFF)
+    {
+        h = ngx_array_push(&cmcf->phases[NGX_HTTP_PREACCESS_PHASE].handlers);
+        if (h == NULL) {
+            return NGX_ERROR;
+        }
+
+        *h = ngx_http_accounting_ctx_handler;
+    }
+
+    // handlers of a phase run last pushed first, the quota check goes in
+    // front of the access and auth modules so that it runs after them
+    if (amcf->quotas != NULL) {
+        h = ngx_array_push(&cmcf->phases[NGX_HTTP_ACCESS_PHASE].handlers);
+        if (h == NULL) {
+            return NGX_ERROR;
+        }
+
+        h = cmcf->phases[NGX_HTTP_ACCESS_PHASE].handlers.elts;
+        ngx_memmove(&h[1], &h[0],
+                    (cmcf->phases[NGX_HTTP_ACCESS_PHASE].handlers.nelts - 1)
+                    * sizeof(ngx_http_handler_pt));
+
+        h[0] = ngx_http_accounting_quota_handler;
+    }
+
     return NGX_OK;
 }
 
@@ -126,6 +286,12 @@ ngx_http_accounting_create_main_conf(ngx_conf_t *cf)
 
     amcf->enable = NGX_CONF_UNSET;
     amcf->interval = NGX_CONF_UNSET;
+    amcf->depth = NGX_CONF_UNSET;
+    amcf->sampling = NGX_CONF_UNSET;
+    amcf->progressive = NGX_CONF_UNSET;
+    amcf->concurrency = NGX_CONF_UNSET;
+    amcf->cpu = NGX_CONF_UNSET_UINT;
+    amcf->top = NGX_CONF_UNSET;
 
     return amcf;
 }
@@ -142,11 +308,196 @@ ngx_http_accounting_init_main_conf(ngx_conf_t *cf, void *conf)
     if (amcf->interval == NGX_CONF_UNSET) {
         amcf->interval = 10;
     }
+    if (amcf->depth == NGX_CONF_UNSET) {
+        amcf->depth = 1;
+    }
+    if (amcf->sampling == NGX_CONF_UNSET) {
+        amcf->sampling = 0;
+    }
+    if (amcf->progressive == NGX_CONF_UNSET) {
+        amcf->progressive = 0;
+    }
+    if (amcf->concurrency == NGX_CONF_UNSET) {
+        amcf->concurrency = 0;
+    }
+    if (amcf->top == NGX_CONF_UNSET) {
+        amcf->top = 0;
+    }
+    if (amcf->cpu == NGX_CONF_UNSET_UINT) {
+        amcf->cpu = NGX_HTTP_ACCOUNTING_CPU_OFF;
+    }
+
+#if !(defined(__x86_64__) || defined(__i386__))
+    if (amcf->cpu == NGX_HTTP_ACCOUNTING_CPU_TSC) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"http_accounting_cpu tsc\" is only supported on x86");
+        return NGX_CONF_ERROR;
+    }
+#endif
+
+    if (amcf->top < 0 || amcf->top > NGX_HTTP_ACCOUNTING_TOP_MAX) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"http_accounting_top\" must be between 0 and %d",
+                           NGX_HTTP_ACCOUNTING_TOP_MAX);
+        return NGX_CONF_ERROR;
+    }
+
+    if (amcf->depth < 1 || amcf->depth > NGX_HTTP_ACCOUNTING_MAX_DEPTH) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"http_accounting_depth\" must be between 1 and %d",
+                           NGX_HTTP_ACCOUNTING_MAX_DEPTH);
+        return NGX_CONF_ERROR;
+    }
+
+    if (amcf->depth_caps != NULL && amcf->depth_caps->nelts > (ngx_uint_t) amcf->depth) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "more \"http_accounting_depth_caps\" than levels");
+        return NGX_CONF_ERROR;
+    }
+
+    if (amcf->snapshot_path.len
+        && ngx_conf_full_name(cf->cycle, &amcf->snapshot_path, 0) != NGX_OK)
+    {
+        return NGX_CONF_ERROR;
+    }
+
+    if (amcf->enable && ngx_http_accounting_quota_init_conf(cf) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (amcf->enable && ngx_http_accounting_slo_init_conf(cf) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (amcf->status && amcf->history == NULL) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "\"http_accounting_status\" requires \"http_accounting_history\"");
+        return NGX_CONF_ERROR;
+    }
+
+    if (amcf->enable && ngx_http_accounting_history_init_conf(cf) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
 
     return NGX_CONF_OK;
 }
 
 
+// http_accounting_depth_caps max_level1 [max_level2 ...]; 0 means unlimited
+static char *
+ngx_http_accounting_depth_caps(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_accounting_main_conf_t *amcf = conf;
+
+    ngx_str_t   *value;
+    ngx_int_t   *cap;
+    ngx_uint_t   i;
+
+    if (amcf->depth_caps != NULL) {
+        return "is duplicate";
+    }
+
+    amcf->depth_caps = ngx_array_create(cf->pool, cf->args->nelts - 1, sizeof(ngx_int_t));
+    if (amcf->depth_caps == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    value = cf->args->elts;
+
+    for (i = 1; i < cf->args->nelts; i++) {
+        cap = ngx_array_push(amcf->depth_caps);
+        if (cap == NULL) {
+            return NGX_CONF_ERROR;
+        }
+
+        *cap = ngx_atoi(value[i].data, value[i].len);
+        if (*cap == NGX_ERROR) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid value \"%V\"", &value[i]);
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    return NGX_CONF_OK;
+}
+
+
+// http_accounting_distinct $variable [size=4k];
+static char *
+ngx_http_accounting_distinct(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_accounting_main_conf_t *amcf = conf;
+
+    ssize_t                          size;
+    ngx_str_t                       *value, s;
+    ngx_http_accounting_distinct_t  *distinct;
+
+    if (amcf->distincts == NULL) {
+        amcf->distincts = ngx_array_create(cf->pool, NGX_HTTP_ACCOUNTING_MAX_DISTINCT,
+                                           sizeof(ngx_http_accounting_distinct_t));
+        if (amcf->distincts == NULL) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    if (amcf->distincts->nelts == NGX_HTTP_ACCOUNTING_MAX_DISTINCT) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "too many \"http_accounting_distinct\", at most %d",
+                           NGX_HTTP_ACCOUNTING_MAX_DISTINCT);
+        return NGX_CONF_ERROR;
+    }
+
+    value = cf->args->elts;
+
+    if (value[1].len < 2 || value[1].data[0] != '$') {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid variable name \"%V\"", &value[1]);
+        return NGX_CONF_ERROR;
+    }
+
+    distinct = ngx_array_push(amcf->distincts);
+    if (distinct == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    distinct->name.len = value[1].len - 1;
+    distinct->name.data = value[1].data + 1;
+
+    distinct->index = ngx_http_get_variable_index(cf, &distinct->name);
+    if (distinct->index == NGX_ERROR) {
+        return NGX_CONF_ERROR;
+    }
+
+    size = 4096;
+
+    if (cf->args->nelts == 3) {
+        if (ngx_strncmp(value[2].data, "size=", 5) != 0) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[2]);
+            return NGX_CONF_ERROR;
+        }
+
+        s.len = value[2].len - 5;
+        s.data = value[2].data + 5;
+
+        size = ngx_parse_size(&s);
+    }
+
+    // one byte per register, the size has to be a power of two
+    for (distinct->precision = NGX_HTTP_ACCOUNTING_HLL_MIN_PRECISION;
+         distinct->precision <= NGX_HTTP_ACCOUNTING_HLL_MAX_PRECISION;
+         distinct->precision++)
+    {
+        if (size == (ssize_t) 1 << distinct->precision) {
+            return NGX_CONF_OK;
+        }
+    }
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                       "\"size\" must be a power of two between %d and %d",
+                       1 << NGX_HTTP_ACCOUNTING_HLL_MIN_PRECISION,
+                       1 << NGX_HTTP_ACCOUNTING_HLL_MAX_PRECISION);
+
+    return NGX_CONF_ERROR;
+}
+
+
 static void *
 ngx_http_accounting_create_loc_conf(ngx_conf_t *cf)
 {
@@ -5,6 +5,12 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 
+#include "ngx_http_accounting_hash.h"
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_registry.h"
+#include "ngx_http_accounting_exporter.h"
+#include "ngx_http_accounting_file.h"
+
 
 typedef struct {
     ngx_str_t       accounting_id;
@@ -13,6 +19,29 @@ typedef struct {
 typedef struct {
     ngx_flag_t      enable;
     ngx_int_t       interval;
+    ngx_int_t       sampling;
+    ngx_flag_t      progressive;
+    ngx_flag_t      concurrency;
+    ngx_uint_t      cpu;            /* NGX_HTTP_ACCOUNTING_CPU_* */
+    ngx_int_t       top;            /* requests kept per id and kind, 0 is off */
+    ngx_int_t       depth;
+    ngx_array_t    *depth_caps;
+    ngx_str_t       snapshot_path;
+    ngx_array_t    *distincts;
+
+    ngx_http_accounting_registry_t  *registry;
+    ngx_http_accounting_history_t   *history;
+    ngx_http_accounting_exporter_t  *exporter;
+    ngx_http_accounting_file_t      *file;      /* lines go there instead of syslog */
+    ngx_flag_t                       status;    /* some location has http_accounting_status */
+
+    ngx_array_t                 *quotas;
+    ngx_http_accounting_hash_t   quotas_hash;
+
+    ngx_array_t                 *slos;
+    ngx_http_accounting_hash_t   slos_hash;
+    ngx_msec_t                   slo_latencies[NGX_HTTP_ACCOUNTING_SLO_MAX_LATENCIES];
+    ngx_uint_t                   nr_slo_latencies;
 } ngx_http_accounting_main_conf_t;
 
 extern ngx_module_t ngx_http_accounting_module;
@@ -0,0 +1,166 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "ngx_http_accounting_mph.h"
+
+
+#define MPH_MAX_DISPLACEMENT  (1u << 24)
+
+
+static uint32_t  *mph_bucket_size;
+
+
+static int
+mph_bucket_cmp(const void *one, const void *two)
+{
+    uint32_t  a = *(const uint32_t *) one;
+    uint32_t  b = *(const uint32_t *) two;
+
+    if (mph_bucket_size[a] != mph_bucket_size[b]) {
+        return mph_bucket_size[a] < mph_bucket_size[b] ? 1 : -1;
+    }
+
+    return (a > b) - (a < b);
+}
+
+
+/*
+ * Builds the hash for n distinct key hashes (n < 2^31) and stores the slot
+ * of hashes[i] in slots[i]. Returns 0 on success, -1 on allocation failure
+ * and -2 if two keys can not be told apart, e.g. duplicate hashes.
+ */
+int
+ngx_http_accounting_mph_build(ngx_http_accounting_mph_t *mph, const uint64_t *hashes, uint32_t n,
+    uint32_t *slots)
+{
+    int        rc = -1;
+    uint8_t   *taken = NULL;
+    uint32_t  *start = NULL, *keys = NULL, *order = NULL, *size = NULL;
+    uint32_t   i, j, b, k, d, nr_buckets, free_slot;
+    uint32_t   tried[64];
+
+    memset(mph, 0, sizeof(ngx_http_accounting_mph_t));
+
+    if (n == 0 || n >= NGX_HTTP_ACCOUNTING_MPH_DIRECT) {
+        return n == 0 ? 0 : -1;
+    }
+
+    nr_buckets = n / 4 + 1;
+
+    mph->n = n;
+    mph->nr_buckets = nr_buckets;
+    mph->buckets = calloc(nr_buckets, sizeof(uint32_t));
+    size = calloc(nr_buckets, sizeof(uint32_t));
+    start = calloc(nr_buckets + 1, sizeof(uint32_t));
+    order = malloc(nr_buckets * sizeof(uint32_t));
+    keys = malloc(n * sizeof(uint32_t));
+    taken = calloc(n, 1);
+
+    if (mph->buckets == NULL || size == NULL || start == NULL || order == NULL || keys == NULL
+        || taken == NULL)
+    {
+        goto done;
+    }
+
+    // group the keys by bucket
+    for (i = 0; i < n; i++) {
+        size[(uint32_t) hashes[i] % nr_buckets]++;
+    }
+
+    for (b = 0; b < nr_buckets; b++) {
+        start[b + 1] = start[b] + size[b];
+        order[b] = b;
+    }
+
+    for (i = 0; i < n; i++) {
+        b = (uint32_t) hashes[i] % nr_buckets;
+        keys[start[b + 1] - size[b]--] = i;
+    }
+
+    for (b = 0; b < nr_buckets; b++) {
+        size[b] = start[b + 1] - start[b];
+    }
+
+    // the largest buckets are placed first, while most slots are still free
+    mph_bucket_size = size;
+    qsort(order, nr_buckets, sizeof(uint32_t), mph_bucket_cmp);
+
+    free_slot = 0;
+
+    for (i = 0; i < nr_buckets && size[order[i]]; i++) {
+        b = order[i];
+
+        if (size[b] == 1) {
+            while (taken[free_slot]) {
+                free_slot++;
+            }
+
+            k = keys[start[b]];
+            taken[free_slot] = 1;
+            slots[k] = free_slot;
+            mph->buckets[b] = free_slot | NGX_HTTP_ACCOUNTING_MPH_DIRECT;
+            continue;
+        }
+
+        if (size[b] > sizeof(tried) / sizeof(tried[0])) {
+            rc = -2;
+            goto done;
+        }
+
+        for (d = 0; d < MPH_MAX_DISPLACEMENT; d++) {
+            for (j = 0; j < size[b]; j++) {
+                tried[j] = ngx_http_accounting_mph_displace(hashes[keys[start[b] + j]], d, n);
+
+                if (taken[tried[j]]) {
+                    break;
+                }
+
+                // keys of this bucket may displace onto each other as well
+                taken[tried[j]] = 1;
+            }
+
+            if (j == size[b]) {
+                break;
+            }
+
+            while (j--) {
+                taken[tried[j]] = 0;
+            }
+        }
+
+        if (d == MPH_MAX_DISPLACEMENT) {
+            rc = -2;
+            goto done;
+        }
+
+        mph->buckets[b] = d;
+
+        for (j = 0; j < size[b]; j++) {
+            slots[keys[start[b] + j]] = tried[j];
+        }
+    }
+
+    rc = 0;
+
+done:
+
+    free(taken);
+    free(keys);
+    free(order);
+    free(start);
+    free(size);
+
+    if (rc != 0) {
+        ngx_http_accounting_mph_free(mph);
+    }
+
+    return rc;
+}
+
+
+void
+ngx_http_accounting_mph_free(ngx_http_accounting_mph_t *mph)
+{
+    free(mph->buckets);
+    mph->buckets = NULL;
+}
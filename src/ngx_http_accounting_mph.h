@@ -0,0 +1,57 @@
+#ifndef _NGX_HTTP_ACCOUNTING_MPH_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_MPH_H_INCLUDED_
+
+/*
+ * Minimal perfect hash over a fixed set of 64 bit key hashes, built with
+ * hash and displace: keys are grouped into buckets, every bucket stores the
+ * displacement that moves all of its keys to free slots, or the slot itself
+ * for buckets with a single key. A lookup takes the key hash, one bucket
+ * read and a few multiplications. Only depends on libc.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define NGX_HTTP_ACCOUNTING_MPH_DIRECT  0x80000000
+
+typedef struct {
+    uint32_t     n;
+    uint32_t     nr_buckets;
+    uint32_t    *buckets;
+} ngx_http_accounting_mph_t;
+
+
+int ngx_http_accounting_mph_build(ngx_http_accounting_mph_t *mph, const uint64_t *hashes,
+    uint32_t n, uint32_t *slots);
+void ngx_http_accounting_mph_free(ngx_http_accounting_mph_t *mph);
+
+
+static inline uint32_t
+ngx_http_accounting_mph_displace(uint64_t hash, uint32_t d, uint32_t n)
+{
+    // every displacement scatters the keys of a bucket anew (murmur3 finalizer)
+    hash += d * 0x9e3779b97f4a7c15ULL;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    return (uint32_t) (hash % n);
+}
+
+// for keys outside the set the result is an arbitrary slot below n
+static inline uint32_t
+ngx_http_accounting_mph_slot(ngx_http_accounting_mph_t *mph, uint64_t hash)
+{
+    uint32_t  g = mph->buckets[(uint32_t) hash % mph->nr_buckets];
+
+    if (g & NGX_HTTP_ACCOUNTING_MPH_DIRECT) {
+        return g & ~NGX_HTTP_ACCOUNTING_MPH_DIRECT;
+    }
+
+    return ngx_http_accounting_mph_displace(hash, g, mph->n);
+}
+
+#endif /* _NGX_HTTP_ACCOUNTING_MPH_H_INCLUDED_ */
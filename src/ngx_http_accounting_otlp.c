@@ -0,0 +1,326 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "ngx_http_accounting_otlp.h"
+
+
+#define PB_VARINT       0
+#define PB_FIXED64      1
+#define PB_LEN          2
+
+
+static void
+pb_put(ngx_http_accounting_pb_t *pb, uint8_t byte)
+{
+    if (pb->len < pb->size) {
+        pb->buf[pb->len] = byte;
+    }
+
+    pb->len++;
+}
+
+
+static void
+pb_raw_varint(ngx_http_accounting_pb_t *pb, uint64_t v)
+{
+    while (v >= 0x80) {
+        pb_put(pb, (uint8_t) (v | 0x80));
+        v >>= 7;
+    }
+
+    pb_put(pb, (uint8_t) v);
+}
+
+
+void
+ngx_http_accounting_pb_init(ngx_http_accounting_pb_t *pb, uint8_t *buf, size_t size)
+{
+    memset(pb, 0, sizeof(ngx_http_accounting_pb_t));
+
+    pb->buf = buf;
+    pb->size = buf ? size : 0;
+}
+
+
+void
+ngx_http_accounting_pb_varint(ngx_http_accounting_pb_t *pb, unsigned field, uint64_t v)
+{
+    pb_raw_varint(pb, (uint64_t) field << 3 | PB_VARINT);
+    pb_raw_varint(pb, v);
+}
+
+
+static void
+pb_raw_fixed64(ngx_http_accounting_pb_t *pb, uint64_t v)
+{
+    int  i;
+
+    for (i = 0; i < 8; i++) {
+        pb_put(pb, (uint8_t) (v >> (8 * i)));
+    }
+}
+
+
+void
+ngx_http_accounting_pb_fixed64(ngx_http_accounting_pb_t *pb, unsigned field, uint64_t v)
+{
+    pb_raw_varint(pb, (uint64_t) field << 3 | PB_FIXED64);
+    pb_raw_fixed64(pb, v);
+}
+
+
+void
+ngx_http_accounting_pb_bytes(ngx_http_accounting_pb_t *pb, unsigned field, const void *data,
+    size_t len)
+{
+    pb_raw_varint(pb, (uint64_t) field << 3 | PB_LEN);
+    pb_raw_varint(pb, len);
+
+    if (pb->len + len <= pb->size) {
+        memcpy(pb->buf + pb->len, data, len);
+    }
+
+    pb->len += len;
+}
+
+
+void
+ngx_http_accounting_pb_begin(ngx_http_accounting_pb_t *pb, unsigned field)
+{
+    pb_raw_varint(pb, (uint64_t) field << 3 | PB_LEN);
+
+    if (pb->depth == NGX_HTTP_ACCOUNTING_PB_MAX_DEPTH) {
+        pb->error = 1;
+        return;
+    }
+
+    pb->open[pb->depth++] = pb->len;
+    pb->len += 4;
+}
+
+
+void
+ngx_http_accounting_pb_end(ngx_http_accounting_pb_t *pb)
+{
+    size_t    at, len;
+    uint8_t  *p;
+
+    if (pb->error) {
+        return;
+    }
+
+    at = pb->open[--pb->depth];
+    len = pb->len - at - 4;
+
+    if (len > NGX_HTTP_ACCOUNTING_PB_MAX_LEN) {
+        pb->error = 1;
+        return;
+    }
+
+    if (at + 4 > pb->size) {
+        return;
+    }
+
+    p = pb->buf + at;
+    p[0] = 0x80 | (len & 0x7f);
+    p[1] = 0x80 | ((len >> 7) & 0x7f);
+    p[2] = 0x80 | ((len >> 14) & 0x7f);
+    p[3] = (len >> 21) & 0x7f;
+}
+
+
+static void
+pb_string(ngx_http_accounting_pb_t *pb, unsigned field, const char *s)
+{
+    ngx_http_accounting_pb_bytes(pb, field, s, strlen(s));
+}
+
+
+// KeyValue { string key = 1; AnyValue value = 2; }, AnyValue { string string_value = 1; }
+static void
+otlp_attribute(ngx_http_accounting_pb_t *pb, unsigned field, const char *key, const void *value,
+    size_t len)
+{
+    ngx_http_accounting_pb_begin(pb, field);
+    pb_string(pb, 1, key);
+    ngx_http_accounting_pb_begin(pb, 2);
+    ngx_http_accounting_pb_bytes(pb, 1, value, len);
+    ngx_http_accounting_pb_end(pb);
+    ngx_http_accounting_pb_end(pb);
+}
+
+
+// AnyValue { int64 int_value = 3; }
+static void
+otlp_int_attribute(ngx_http_accounting_pb_t *pb, unsigned field, const char *key, int64_t value)
+{
+    ngx_http_accounting_pb_begin(pb, field);
+    pb_string(pb, 1, key);
+    ngx_http_accounting_pb_begin(pb, 2);
+    ngx_http_accounting_pb_varint(pb, 3, (uint64_t) value);
+    ngx_http_accounting_pb_end(pb);
+    ngx_http_accounting_pb_end(pb);
+}
+
+
+/*
+ * HistogramDataPoint { fixed64 start_time_unix_nano = 2; fixed64 time_unix_nano = 3;
+ * fixed64 count = 4; repeated fixed64 bucket_counts = 6; repeated double explicit_bounds = 7;
+ * repeated KeyValue attributes = 9; }, the repeated fields packed
+ */
+static void
+otlp_histogram_point(ngx_http_accounting_pb_t *pb, const ngx_http_accounting_otlp_metric_t *metric,
+    const ngx_http_accounting_otlp_resource_t *resource, const ngx_http_accounting_otlp_row_t *row,
+    const uint64_t *buckets)
+{
+    unsigned  k;
+    uint64_t  count, bits;
+
+    for (k = 0, count = 0; k < metric->width; k++) {
+        count += buckets[k];
+    }
+
+    ngx_http_accounting_pb_begin(pb, 1);                /* data_points */
+    ngx_http_accounting_pb_fixed64(pb, 2, resource->from_ns);
+    ngx_http_accounting_pb_fixed64(pb, 3, resource->to_ns);
+    ngx_http_accounting_pb_fixed64(pb, 4, count);
+
+    ngx_http_accounting_pb_begin(pb, 6);
+    for (k = 0; k < metric->width; k++) {
+        pb_raw_fixed64(pb, buckets[k]);
+    }
+    ngx_http_accounting_pb_end(pb);
+
+    ngx_http_accounting_pb_begin(pb, 7);
+    for (k = 0; k + 1 < metric->width; k++) {
+        memcpy(&bits, &metric->bounds[k], sizeof(bits));
+        pb_raw_fixed64(pb, bits);
+    }
+    ngx_http_accounting_pb_end(pb);
+
+    otlp_attribute(pb, 9, "accounting.id", row->id, row->id_len);
+    otlp_int_attribute(pb, 9, "accounting.level", row->level);
+
+    ngx_http_accounting_pb_end(pb);
+}
+
+
+/*
+ * ExportMetricsServiceRequest with one ResourceMetrics and one ScopeMetrics,
+ * one Metric per metric and a NumberDataPoint per row and value, or a
+ * HistogramDataPoint per row, attributed with the accounting id. Returns the
+ * encoded length, if that is more than size nothing usable was written: call
+ * it with a NULL buffer to size one.
+ * (size_t) -1 means the request can not be encoded at all.
+ */
+size_t
+ngx_http_accounting_otlp_encode(uint8_t *buf, size_t size,
+    const ngx_http_accounting_otlp_resource_t *resource,
+    const ngx_http_accounting_otlp_metric_t *metrics, unsigned nr_metrics,
+    const ngx_http_accounting_otlp_row_t *rows, size_t nr_rows)
+{
+    size_t                    i, offset;
+    unsigned                  m, k;
+    ngx_http_accounting_pb_t  pb;
+
+    ngx_http_accounting_pb_init(&pb, buf, size);
+
+    ngx_http_accounting_pb_begin(&pb, 1);               /* resource_metrics */
+
+    ngx_http_accounting_pb_begin(&pb, 1);               /* resource */
+    otlp_attribute(&pb, 1, "service.name", resource->service, strlen(resource->service));
+    otlp_attribute(&pb, 1, "host.name", resource->host, strlen(resource->host));
+    otlp_int_attribute(&pb, 1, "process.pid", resource->pid);
+    ngx_http_accounting_pb_end(&pb);
+
+    ngx_http_accounting_pb_begin(&pb, 2);               /* scope_metrics */
+
+    ngx_http_accounting_pb_begin(&pb, 1);               /* scope */
+    pb_string(&pb, 1, "ngx_http_accounting_module");
+    ngx_http_accounting_pb_end(&pb);
+
+    for (m = 0, offset = 0; m < nr_metrics; offset += metrics[m].width, m++) {
+        ngx_http_accounting_pb_begin(&pb, 2);           /* metrics */
+        pb_string(&pb, 1, metrics[m].name);
+        pb_string(&pb, 3, metrics[m].unit);
+
+        // Metric { Gauge gauge = 5; Sum sum = 7; Histogram histogram = 9; }
+        if (metrics[m].kind == NGX_HTTP_ACCOUNTING_OTLP_HISTOGRAM) {
+            ngx_http_accounting_pb_begin(&pb, 9);
+
+            for (i = 0; i < nr_rows; i++) {
+                otlp_histogram_point(&pb, &metrics[m], resource, &rows[i],
+                                     rows[i].values + offset);
+            }
+
+            ngx_http_accounting_pb_varint(&pb, 2, 1);   /* AGGREGATION_TEMPORALITY_DELTA */
+
+            ngx_http_accounting_pb_end(&pb);
+            ngx_http_accounting_pb_end(&pb);
+            continue;
+        }
+
+        ngx_http_accounting_pb_begin(&pb, metrics[m].kind == NGX_HTTP_ACCOUNTING_OTLP_SUM ? 7 : 5);
+
+        for (i = 0; i < nr_rows; i++) {
+            for (k = 0; k < metrics[m].width; k++) {
+                ngx_http_accounting_pb_begin(&pb, 1);   /* data_points */
+
+                if (metrics[m].kind == NGX_HTTP_ACCOUNTING_OTLP_SUM) {
+                    ngx_http_accounting_pb_fixed64(&pb, 2, resource->from_ns);
+                }
+                ngx_http_accounting_pb_fixed64(&pb, 3, resource->to_ns);
+
+                // as_int is a sfixed64
+                ngx_http_accounting_pb_fixed64(&pb, 6, rows[i].values[offset + k]);
+
+                otlp_attribute(&pb, 7, "accounting.id", rows[i].id, rows[i].id_len);
+                otlp_int_attribute(&pb, 7, "accounting.level", rows[i].level);
+
+                if (metrics[m].variants) {
+                    otlp_attribute(&pb, 7, metrics[m].variant_key, metrics[m].variants[k],
+                                   strlen(metrics[m].variants[k]));
+                }
+
+                ngx_http_accounting_pb_end(&pb);
+            }
+        }
+
+        if (metrics[m].kind == NGX_HTTP_ACCOUNTING_OTLP_SUM) {
+            ngx_http_accounting_pb_varint(&pb, 2, 1);   /* AGGREGATION_TEMPORALITY_DELTA */
+            ngx_http_accounting_pb_varint(&pb, 3, 1);   /* is_monotonic */
+        }
+
+        ngx_http_accounting_pb_end(&pb);
+        ngx_http_accounting_pb_end(&pb);
+    }
+
+    ngx_http_accounting_pb_end(&pb);
+    ngx_http_accounting_pb_end(&pb);
+
+    return pb.error ? (size_t) -1 : pb.len;
+}
+
+
+// header of the POST of an encoded request, returns its length or 0 if it does not fit
+size_t
+ngx_http_accounting_otlp_request(char *buf, size_t size, const char *host, const char *uri,
+    size_t content_length)
+{
+    int  n;
+
+    n = snprintf(buf, size,
+                 "POST %s HTTP/1.1\r\n"
+                 "Host: %s\r\n"
+                 "Content-Type: application/x-protobuf\r\n"
+                 "Content-Length: %zu\r\n"
+                 "Connection: close\r\n"
+                 "\r\n",
+                 uri, host, content_length);
+
+    if (n < 0 || (size_t) n >= size) {
+        return 0;
+    }
+
+    return n;
+}
@@ -0,0 +1,74 @@
+#ifndef _NGX_HTTP_ACCOUNTING_OTLP_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_OTLP_H_INCLUDED_
+
+/*
+ * Encoder of OTLP ExportMetricsServiceRequest protobuf messages, writing
+ * into a caller supplied buffer without allocating. Lengths of nested
+ * messages are written as 4 byte varints, padded with continuation bits,
+ * so that they can be patched in place once a message ends; every decoder
+ * accepts them. Only depends on libc.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define NGX_HTTP_ACCOUNTING_PB_MAX_DEPTH     10
+#define NGX_HTTP_ACCOUNTING_PB_MAX_LEN       ((1 << 28) - 1)
+
+#define NGX_HTTP_ACCOUNTING_OTLP_SUM         1   /* delta, monotonic */
+#define NGX_HTTP_ACCOUNTING_OTLP_GAUGE       2
+#define NGX_HTTP_ACCOUNTING_OTLP_HISTOGRAM   3   /* delta, the values of a row are its buckets */
+
+typedef struct {
+    uint8_t     *buf;
+    size_t       size;
+    size_t       len;           /* bytes needed so far, may exceed size */
+    unsigned     depth;
+    unsigned     error;         /* nested too deep or too long */
+    size_t       open[NGX_HTTP_ACCOUNTING_PB_MAX_DEPTH];
+} ngx_http_accounting_pb_t;
+
+typedef struct {
+    const char          *name;
+    const char          *unit;
+    unsigned             kind;
+    unsigned             width;         /* values per row, one data point each but for histograms */
+    const char          *variant_key;   /* attribute telling the values of a row apart */
+    const char *const   *variants;
+    const double        *bounds;        /* histograms: upper bounds of all buckets but the last */
+} ngx_http_accounting_otlp_metric_t;
+
+// one accounting id; values holds the values of all metrics, in order
+typedef struct {
+    const uint8_t       *id;
+    size_t               id_len;
+    unsigned             level;
+    const uint64_t      *values;
+} ngx_http_accounting_otlp_row_t;
+
+typedef struct {
+    const char          *service;
+    const char          *host;
+    int64_t              pid;
+    uint64_t             from_ns;
+    uint64_t             to_ns;
+} ngx_http_accounting_otlp_resource_t;
+
+
+void ngx_http_accounting_pb_init(ngx_http_accounting_pb_t *pb, uint8_t *buf, size_t size);
+void ngx_http_accounting_pb_varint(ngx_http_accounting_pb_t *pb, unsigned field, uint64_t v);
+void ngx_http_accounting_pb_fixed64(ngx_http_accounting_pb_t *pb, unsigned field, uint64_t v);
+void ngx_http_accounting_pb_bytes(ngx_http_accounting_pb_t *pb, unsigned field, const void *data,
+    size_t len);
+void ngx_http_accounting_pb_begin(ngx_http_accounting_pb_t *pb, unsigned field);
+void ngx_http_accounting_pb_end(ngx_http_accounting_pb_t *pb);
+
+size_t ngx_http_accounting_otlp_encode(uint8_t *buf, size_t size,
+    const ngx_http_accounting_otlp_resource_t *resource,
+    const ngx_http_accounting_otlp_metric_t *metrics, unsigned nr_metrics,
+    const ngx_http_accounting_otlp_row_t *rows, size_t nr_rows);
+size_t ngx_http_accounting_otlp_request(char *buf, size_t size, const char *host,
+    const char *uri, size_t content_length);
+
+#endif /* _NGX_HTTP_ACCOUNTING_OTLP_H_INCLUDED_ */
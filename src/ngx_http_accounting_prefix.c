@@ -6,6 +6,8 @@
 
 u_int find_end_of_path_part(u_char *start, ngx_http_request_t *r);
 
+#define is_path_char(c)  (isalnum(c) || (c) == '_' || (c) == '-')
+
 ngx_str_t extract_routing_prefix(ngx_http_request_t *r)
 {
     u_char *start = r->uri.data;
@@ -58,10 +60,40 @@ u_int find_end_of_path_part(u_char *start, ngx_http_request_t *request)
     u_char *cmp = start;
     u_int idx = 0;
     while (  idx < request->uri.len-1 // uri.len includes the preceding slash which we want to ignore
-             && (isalnum(*cmp) || *cmp == '_' || *cmp == '-'))
+             && is_path_char(*cmp))
     {
         ++idx;
         ++cmp;
     }
     return idx;
-}
\ No newline at end of file
+}
+
+ngx_str_t extract_routing_path(ngx_http_request_t *r, u_int depth)
+{
+    ngx_str_t path = extract_routing_prefix(r);
+
+    // "default" and "malformed-request" do not point into the uri and have no children
+    if (depth <= 1 || path.len == 0
+        || (u_char *)path.data < (u_char *)r->uri.data
+        || (u_char *)path.data >= (u_char *)r->uri.data + r->uri.len)
+    {
+        return path;
+    }
+
+    // We extend the prefix by up to depth-1 further path parts, so that "/rest/namespace/endpoint/1"
+    // with a depth of 2 yields "namespace/endpoint". The parts stay separated by single slashes.
+    u_char *end = (u_char *)r->uri.data + r->uri.len;
+    u_char *p = (u_char *)path.data + path.len;
+
+    while (--depth && p + 1 < end && *p == '/' && is_path_char(p[1]))
+    {
+        ++p;
+        while (p < end && is_path_char(*p))
+        {
+            ++p;
+        }
+    }
+
+    path.len = p - (u_char *)path.data;
+    return path;
+}
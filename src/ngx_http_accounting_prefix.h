@@ -7,4 +7,5 @@
 #include "../tests/fakes.h"
 #endif
 
-ngx_str_t extract_routing_prefix(ngx_http_request_t *r);
\ No newline at end of file
+ngx_str_t extract_routing_prefix(ngx_http_request_t *r);
+ngx_str_t extract_routing_path(ngx_http_request_t *r, u_int depth);
\ No newline at end of file
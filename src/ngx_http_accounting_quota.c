@@ -0,0 +1,278 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_hash.h"
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_module.h"
+#include "ngx_http_accounting_quota.h"
+
+
+static ngx_str_t  ngx_http_accounting_quota_zone_name = ngx_string("http_accounting_quota");
+
+static ngx_int_t ngx_http_accounting_quota_init_zone(ngx_shm_zone_t *shm_zone, void *data);
+
+
+// http_accounting_quota id [requests=N] [bytes=SIZE] per=TIME [status=CODE];
+char *
+ngx_http_accounting_quota(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_accounting_main_conf_t *amcf = conf;
+
+    ngx_str_t                    *value, s;
+    ngx_int_t                     n;
+    ngx_uint_t                    i;
+    ngx_http_accounting_quota_t  *quota;
+
+    if (amcf->quotas == NULL) {
+        amcf->quotas = ngx_array_create(cf->pool, 4, sizeof(ngx_http_accounting_quota_t));
+        if (amcf->quotas == NULL) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    quota = ngx_array_push(amcf->quotas);
+    if (quota == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_memzero(quota, sizeof(ngx_http_accounting_quota_t));
+
+    value = cf->args->elts;
+
+    quota->id = value[1];
+    quota->status = NGX_HTTP_ACCOUNTING_QUOTA_STATUS;
+    quota->index = amcf->quotas->nelts - 1;
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "requests=", 9) == 0) {
+            n = ngx_atoi(value[i].data + 9, value[i].len - 9);
+            if (n <= 0) {
+                goto invalid;
+            }
+            quota->requests = n;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "bytes=", 6) == 0) {
+            s.len = value[i].len - 6;
+            s.data = value[i].data + 6;
+            quota->bytes = ngx_parse_offset(&s);
+            if (quota->bytes <= 0) {
+                goto invalid;
+            }
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "per=", 4) == 0) {
+            s.len = value[i].len - 4;
+            s.data = value[i].data + 4;
+            quota->per = ngx_parse_time(&s, 1);
+            if (quota->per == (time_t) NGX_ERROR || quota->per == 0) {
+                goto invalid;
+            }
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "status=", 7) == 0) {
+            n = ngx_atoi(value[i].data + 7, value[i].len - 7);
+            if (n < 400 || n > 599) {
+                goto invalid;
+            }
+            quota->status = n;
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    if (quota->per == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "\"per\" must be set for quota \"%V\"", &quota->id);
+        return NGX_CONF_ERROR;
+    }
+
+    if (quota->requests == 0 && quota->bytes == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "quota \"%V\" needs \"requests\" or \"bytes\"", &quota->id);
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+ngx_int_t
+ngx_http_accounting_quota_init_conf(ngx_conf_t *cf)
+{
+    size_t                            size;
+    ngx_uint_t                        i, key;
+    ngx_shm_zone_t                   *zone;
+    ngx_http_accounting_quota_t      *quotas;
+    ngx_http_accounting_main_conf_t  *amcf;
+
+    amcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_accounting_module);
+
+    if (amcf->quotas == NULL) {
+        return NGX_OK;
+    }
+
+    size = 8 * ngx_pagesize + amcf->quotas->nelts * sizeof(ngx_http_accounting_quota_slot_t);
+
+    zone = ngx_shared_memory_add(cf, &ngx_http_accounting_quota_zone_name, size,
+                                 &ngx_http_accounting_module);
+    if (zone == NULL) {
+        return NGX_ERROR;
+    }
+
+    zone->init = ngx_http_accounting_quota_init_zone;
+    zone->data = amcf->quotas;
+
+    if (ngx_http_accounting_hash_init(&amcf->quotas_hash, NGX_HTTP_ACCOUNTING_NR_BUCKETS, cf->pool)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    quotas = amcf->quotas->elts;
+
+    for (i = 0; i < amcf->quotas->nelts; i++) {
+        quotas[i].zone = zone;
+
+        key = ngx_hash_key_lc(quotas[i].id.data, quotas[i].id.len);
+        quotas[i].key = key;
+
+        if (ngx_http_accounting_hash_find(&amcf->quotas_hash, key, quotas[i].id.data, quotas[i].id.len)
+            != NULL)
+        {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "duplicate quota \"%V\"", &quotas[i].id);
+            return NGX_ERROR;
+        }
+
+        if (ngx_http_accounting_hash_add(&amcf->quotas_hash, key, quotas[i].id.data,
+                                         quotas[i].id.len, &quotas[i])
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+/*
+ * The zone is reused across a reload as long as its size, and so the number
+ * of quotas, stays the same. Budgets in use are kept, a slot that now belongs
+ * to another id starts over.
+ */
+static ngx_int_t
+ngx_http_accounting_quota_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    size_t                             size;
+    ngx_uint_t                         i;
+    ngx_array_t                       *quotas = shm_zone->data;
+    ngx_slab_pool_t                   *shpool;
+    ngx_http_accounting_quota_t       *quota;
+    ngx_http_accounting_quota_slot_t  *slots;
+
+    size = quotas->nelts * sizeof(ngx_http_accounting_quota_slot_t);
+
+    if (data) {
+        slots = data;
+
+    } else {
+        shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+        slots = ngx_slab_alloc(shpool, size);
+        if (slots == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memzero(slots, size);
+    }
+
+    quota = quotas->elts;
+
+    for (i = 0; i < quotas->nelts; i++) {
+        if (slots[i].key != quota[i].key) {
+            ngx_memzero(&slots[i], sizeof(ngx_http_accounting_quota_slot_t));
+            slots[i].key = quota[i].key;
+        }
+    }
+
+    shm_zone->data = slots;
+
+    return NGX_OK;
+}
+
+
+ngx_http_accounting_quota_t *
+ngx_http_accounting_quota_find(ngx_http_accounting_main_conf_t *amcf, ngx_uint_t key, ngx_str_t *id)
+{
+    if (amcf->quotas == NULL) {
+        return NULL;
+    }
+
+    return ngx_http_accounting_hash_find(&amcf->quotas_hash, key, id->data, id->len);
+}
+
+
+/*
+ * Counts a request against the quota of its id as it passes the access
+ * phase, so requests running at the same time cannot all pass the check.
+ * A rejected request is taken back out. Bytes are only known once a request
+ * is done and charged then.
+ */
+ngx_int_t
+ngx_http_accounting_quota_reserve(ngx_http_accounting_quota_t *quota)
+{
+    ngx_atomic_uint_t                  window, old, requests;
+    ngx_http_accounting_quota_slot_t  *slot;
+
+    slot = (ngx_http_accounting_quota_slot_t *) quota->zone->data + quota->index;
+
+    // the first worker to see a new window resets it; charges racing with
+    // the reset may be lost, which only errs in favour of the client
+    window = ngx_time() / quota->per;
+    old = slot->window;
+
+    if (old != window && ngx_atomic_cmp_set(&slot->window, old, window)) {
+        slot->requests = 0;
+        slot->bytes = 0;
+    }
+
+    requests = ngx_atomic_fetch_add(&slot->requests, 1);
+
+    if ((quota->requests && requests >= quota->requests)
+        || (quota->bytes && slot->bytes >= (ngx_atomic_uint_t) quota->bytes))
+    {
+        (void) ngx_atomic_fetch_add(&slot->requests, (ngx_atomic_int_t) -1);
+        return NGX_DECLINED;
+    }
+
+    return NGX_OK;
+}
+
+
+// requests that were not reserved (stream sessions, requests ended before the access phase) and bytes
+void
+ngx_http_accounting_quota_charge(ngx_http_accounting_quota_t *quota, ngx_uint_t requests,
+    ngx_uint_t bytes)
+{
+    ngx_http_accounting_quota_slot_t  *slot;
+
+    slot = (ngx_http_accounting_quota_slot_t *) quota->zone->data + quota->index;
+
+    if (requests) {
+        (void) ngx_atomic_fetch_add(&slot->requests, requests);
+    }
+
+    (void) ngx_atomic_fetch_add(&slot->bytes, bytes);
+}
@@ -0,0 +1,42 @@
+#ifndef _NGX_HTTP_ACCOUNTING_QUOTA_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_QUOTA_H_INCLUDED_
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_module.h"
+
+
+#define NGX_HTTP_ACCOUNTING_QUOTA_STATUS    429
+
+// shared between all workers, updated with atomics only
+typedef struct {
+    ngx_atomic_t     window;
+    ngx_atomic_t     requests;
+    ngx_atomic_t     bytes;
+    ngx_atomic_t     key;           /* of the id, to keep the budget across reloads */
+} ngx_http_accounting_quota_slot_t;
+
+struct ngx_http_accounting_quota_s {
+    ngx_str_t        id;
+    ngx_uint_t       key;
+    ngx_uint_t       requests;
+    off_t            bytes;
+    time_t           per;
+    ngx_uint_t       status;
+    ngx_uint_t       index;
+    ngx_shm_zone_t  *zone;
+};
+
+char *ngx_http_accounting_quota(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_accounting_quota_init_conf(ngx_conf_t *cf);
+
+ngx_http_accounting_quota_t *ngx_http_accounting_quota_find(
+                ngx_http_accounting_main_conf_t *amcf, ngx_uint_t key, ngx_str_t *id);
+ngx_int_t ngx_http_accounting_quota_reserve(ngx_http_accounting_quota_t *quota);
+void ngx_http_accounting_quota_charge(ngx_http_accounting_quota_t *quota, ngx_uint_t requests,
+                ngx_uint_t bytes);
+
+#endif /* _NGX_HTTP_ACCOUNTING_QUOTA_H_INCLUDED_ */
@@ -0,0 +1,328 @@
+#include <string.h>
+
+#include "ngx_http_accounting_record.h"
+
+
+static const char  record_digits[] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static const char  record_hex[] = "0123456789abcdef";
+
+
+// writes v in decimal at p, two digits at a time, and returns the end
+char *
+ngx_http_accounting_format_uint(char *p, uint64_t v)
+{
+    char      tmp[NGX_HTTP_ACCOUNTING_UINT_LEN];
+    char     *t;
+    unsigned  d;
+    size_t    len;
+
+    t = tmp + sizeof(tmp);
+
+    while (v >= 100) {
+        d = (unsigned) (v % 100) * 2;
+        v /= 100;
+        *--t = record_digits[d + 1];
+        *--t = record_digits[d];
+    }
+
+    if (v >= 10) {
+        d = (unsigned) v * 2;
+        *--t = record_digits[d + 1];
+        *--t = record_digits[d];
+
+    } else {
+        *--t = (char) ('0' + v);
+    }
+
+    len = tmp + sizeof(tmp) - t;
+    memcpy(p, t, len);
+
+    return p + len;
+}
+
+
+static void
+record_put(ngx_http_accounting_record_t *rec, const char *s, size_t len)
+{
+    if (rec->full || (size_t) (rec->end - rec->pos) < len) {
+        rec->full = 1;
+        return;
+    }
+
+    memcpy(rec->pos, s, len);
+    rec->pos += len;
+}
+
+
+static void
+record_put_uint(ngx_http_accounting_record_t *rec, uint64_t v)
+{
+    char  tmp[NGX_HTTP_ACCOUNTING_UINT_LEN];
+
+    if (rec->end - rec->pos >= NGX_HTTP_ACCOUNTING_UINT_LEN && !rec->full) {
+        rec->pos = ngx_http_accounting_format_uint(rec->pos, v);
+        return;
+    }
+
+    record_put(rec, tmp, ngx_http_accounting_format_uint(tmp, v) - tmp);
+}
+
+
+static void
+record_put_escaped(ngx_http_accounting_record_t *rec, const char *s, size_t len)
+{
+    char          esc[6];
+    size_t        i;
+    unsigned char c;
+
+    for (i = 0; i < len && !rec->full; i++) {
+        c = (unsigned char) s[i];
+
+        // the separator and control characters of ids and URIs percent-encoded in syslog lines
+        if (rec->format == NGX_HTTP_ACCOUNTING_RECORD_SYSLOG) {
+            if (c == '|' || c < 0x20 || c == 0x7f) {
+                esc[0] = '%';
+                esc[1] = record_hex[c >> 4];
+                esc[2] = record_hex[c & 0xf];
+                record_put(rec, esc, 3);
+
+            } else {
+                record_put(rec, s + i, 1);
+            }
+
+        } else if (c == '\\' || (c == '"' && rec->format == NGX_HTTP_ACCOUNTING_RECORD_JSON)) {
+            esc[0] = '\\';
+            esc[1] = (char) c;
+            record_put(rec, esc, 2);
+
+        } else if (c == '\t' || c == '\n' || c == '\r') {
+            esc[0] = '\\';
+            esc[1] = c == '\t' ? 't' : c == '\n' ? 'n' : 'r';
+            record_put(rec, esc, 2);
+
+        } else if (c < 0x20 && rec->format == NGX_HTTP_ACCOUNTING_RECORD_JSON) {
+            memcpy(esc, "\\u00", 4);
+            esc[4] = record_hex[c >> 4];
+            esc[5] = record_hex[c & 0xf];
+            record_put(rec, esc, 6);
+
+        } else {
+            record_put(rec, s + i, 1);
+        }
+    }
+}
+
+
+static void
+record_key(ngx_http_accounting_record_t *rec, const char *name)
+{
+    static const char  separators[] = { '|', '\t', ',' };
+
+    if (rec->fields++ > 0) {
+        record_put(rec, &separators[rec->format], 1);
+    }
+
+    if (rec->format == NGX_HTTP_ACCOUNTING_RECORD_JSON) {
+        record_put(rec, "\"", 1);
+        record_put_escaped(rec, name, strlen(name));
+        record_put(rec, "\":", 2);
+
+    } else if (rec->extras) {
+        record_put_escaped(rec, name, strlen(name));
+        record_put(rec, "=", 1);
+    }
+}
+
+
+void
+ngx_http_accounting_record_begin(ngx_http_accounting_record_t *rec, char *buf, size_t size,
+    unsigned format)
+{
+    size_t  reserve;
+
+    memset(rec, 0, sizeof(ngx_http_accounting_record_t));
+
+    rec->start = buf;
+    rec->pos = buf;
+    rec->format = format;
+
+    // "}\n" for JSON, '\n' for TSV and the NUL of syslog lines
+    reserve = format == NGX_HTTP_ACCOUNTING_RECORD_JSON ? 2 : 1;
+
+    // no room for a record at all, it stays empty and full
+    if (size <= reserve) {
+        rec->end = buf;
+        rec->full = 1;
+        return;
+    }
+
+    rec->end = buf + size - reserve;
+
+    if (format == NGX_HTTP_ACCOUNTING_RECORD_JSON) {
+        record_put(rec, "{", 1);
+    }
+}
+
+
+void
+ngx_http_accounting_record_extras(ngx_http_accounting_record_t *rec)
+{
+    rec->extras = 1;
+}
+
+
+void
+ngx_http_accounting_record_uint(ngx_http_accounting_record_t *rec, const char *name, uint64_t v)
+{
+    char  *pos = rec->pos;
+
+    record_key(rec, name);
+    record_put_uint(rec, v);
+
+    if (rec->full) {
+        rec->pos = pos;
+    }
+}
+
+
+// v rounded to decimals (at most 9) digits after the point, negative values and NaN are written as 0
+void
+ngx_http_accounting_record_fixed(ngx_http_accounting_record_t *rec, const char *name, double v,
+    unsigned decimals)
+{
+    char      *pos = rec->pos;
+    char       frac[NGX_HTTP_ACCOUNTING_UINT_LEN];
+    uint64_t   scale, n;
+    unsigned   i;
+
+    for (i = 0, scale = 1; i < decimals; i++) {
+        scale *= 10;
+    }
+
+    if (!(v > 0)) {
+        v = 0;
+    }
+
+    if (v >= (double) UINT64_MAX / scale) {
+        n = UINT64_MAX / scale * scale;
+    } else {
+        n = (uint64_t) (v * scale + 0.5);
+    }
+
+    record_key(rec, name);
+    record_put_uint(rec, n / scale);
+
+    if (decimals) {
+        record_put(rec, ".", 1);
+
+        // leading zeros of the fraction
+        n = n % scale + scale;
+        record_put(rec, frac + 1, ngx_http_accounting_format_uint(frac, n) - frac - 1);
+    }
+
+    if (rec->full) {
+        rec->pos = pos;
+    }
+}
+
+
+void
+ngx_http_accounting_record_string(ngx_http_accounting_record_t *rec, const char *name,
+    const char *s, size_t len)
+{
+    char  *pos = rec->pos;
+
+    record_key(rec, name);
+
+    if (rec->format == NGX_HTTP_ACCOUNTING_RECORD_JSON) {
+        record_put(rec, "\"", 1);
+        record_put_escaped(rec, s, len);
+        record_put(rec, "\"", 1);
+
+    } else {
+        record_put_escaped(rec, s, len);
+    }
+
+    if (rec->full) {
+        rec->pos = pos;
+    }
+}
+
+
+/*
+ * A list of key:value pairs, "name=k:v,k:v" or "name":{"k":v,"k":v}; one that
+ * does not fit as a whole is left out.
+ */
+void
+ngx_http_accounting_record_list(ngx_http_accounting_record_t *rec, const char *name)
+{
+    rec->mark = rec->pos;
+    rec->items = 0;
+
+    record_key(rec, name);
+
+    if (rec->format == NGX_HTTP_ACCOUNTING_RECORD_JSON) {
+        record_put(rec, "{", 1);
+    }
+}
+
+
+void
+ngx_http_accounting_record_pair(ngx_http_accounting_record_t *rec, uint64_t key, uint64_t v)
+{
+    if (rec->items++ > 0) {
+        record_put(rec, ",", 1);
+    }
+
+    if (rec->format == NGX_HTTP_ACCOUNTING_RECORD_JSON) {
+        record_put(rec, "\"", 1);
+        record_put_uint(rec, key);
+        record_put(rec, "\":", 2);
+
+    } else {
+        record_put_uint(rec, key);
+        record_put(rec, ":", 1);
+    }
+
+    record_put_uint(rec, v);
+}
+
+
+void
+ngx_http_accounting_record_list_end(ngx_http_accounting_record_t *rec)
+{
+    if (rec->format == NGX_HTTP_ACCOUNTING_RECORD_JSON) {
+        record_put(rec, "}", 1);
+    }
+
+    if (rec->full) {
+        rec->pos = rec->mark;
+    }
+}
+
+
+// returns the length of the record, the NUL ending syslog lines not included
+size_t
+ngx_http_accounting_record_end(ngx_http_accounting_record_t *rec)
+{
+    if (rec->end == rec->start) {
+        return 0;
+    }
+
+    if (rec->format == NGX_HTTP_ACCOUNTING_RECORD_JSON) {
+        *rec->pos++ = '}';
+        *rec->pos++ = '\n';
+
+    } else if (rec->format == NGX_HTTP_ACCOUNTING_RECORD_TSV) {
+        *rec->pos++ = '\n';
+
+    } else {
+        *rec->pos = '\0';
+    }
+
+    return rec->pos - rec->start;
+}
@@ -0,0 +1,52 @@
+#ifndef _NGX_HTTP_ACCOUNTING_RECORD_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_RECORD_H_INCLUDED_
+
+/*
+ * Writer of the per id interval records, as a syslog line, a TSV line or a
+ * JSON line, into a caller supplied buffer. Fields written before
+ * ngx_http_accounting_record_extras() are positional, the ones after are
+ * named (name=value) outside of JSON. A field that does not fit ends the
+ * record, which then stays valid but incomplete. Only depends on libc.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define NGX_HTTP_ACCOUNTING_RECORD_SYSLOG    0   /* '|' separated, no line end */
+#define NGX_HTTP_ACCOUNTING_RECORD_TSV       1
+#define NGX_HTTP_ACCOUNTING_RECORD_JSON      2
+
+// longest uint64_t in decimal
+#define NGX_HTTP_ACCOUNTING_UINT_LEN         20
+
+typedef struct {
+    char        *start;
+    char        *pos;
+    char        *end;           /* room for the record end is kept aside */
+    unsigned     format;
+    unsigned     fields;        /* written so far */
+    char        *mark;          /* start of the open list */
+    unsigned     items;         /* of the open list */
+    unsigned     extras:1;
+    unsigned     full:1;        /* a field did not fit */
+} ngx_http_accounting_record_t;
+
+
+char *ngx_http_accounting_format_uint(char *p, uint64_t v);
+
+void ngx_http_accounting_record_begin(ngx_http_accounting_record_t *rec, char *buf, size_t size,
+    unsigned format);
+void ngx_http_accounting_record_extras(ngx_http_accounting_record_t *rec);
+void ngx_http_accounting_record_uint(ngx_http_accounting_record_t *rec, const char *name,
+    uint64_t v);
+void ngx_http_accounting_record_fixed(ngx_http_accounting_record_t *rec, const char *name,
+    double v, unsigned decimals);
+void ngx_http_accounting_record_string(ngx_http_accounting_record_t *rec, const char *name,
+    const char *s, size_t len);
+void ngx_http_accounting_record_list(ngx_http_accounting_record_t *rec, const char *name);
+void ngx_http_accounting_record_pair(ngx_http_accounting_record_t *rec, uint64_t key, uint64_t v);
+void ngx_http_accounting_record_list_end(ngx_http_accounting_record_t *rec);
+size_t ngx_http_accounting_record_end(ngx_http_accounting_record_t *rec);
+
+#endif /* _NGX_HTTP_ACCOUNTING_RECORD_H_INCLUDED_ */
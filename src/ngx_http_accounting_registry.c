@@ -0,0 +1,228 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_module.h"
+#include "ngx_http_accounting_registry.h"
+
+
+static ngx_int_t ngx_http_accounting_registry_load(ngx_conf_t *cf,
+    ngx_http_accounting_registry_t *registry, ngx_str_t *path);
+static void ngx_http_accounting_registry_cleanup(void *data);
+
+
+// http_accounting_registry /path/file [overflow=dynamic|other|drop];
+char *
+ngx_http_accounting_registry(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_accounting_main_conf_t *amcf = conf;
+
+    ngx_str_t                       *value, path;
+    ngx_http_accounting_registry_t  *registry;
+
+    if (amcf->registry != NULL) {
+        return "is duplicate";
+    }
+
+    registry = ngx_pcalloc(cf->pool, sizeof(ngx_http_accounting_registry_t));
+    if (registry == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    value = cf->args->elts;
+
+    if (cf->args->nelts == 3) {
+        if (ngx_strcmp(value[2].data, "overflow=dynamic") == 0) {
+            registry->overflow = NGX_HTTP_ACCOUNTING_OVERFLOW_DYNAMIC;
+
+        } else if (ngx_strcmp(value[2].data, "overflow=other") == 0) {
+            registry->overflow = NGX_HTTP_ACCOUNTING_OVERFLOW_OTHER;
+
+        } else if (ngx_strcmp(value[2].data, "overflow=drop") == 0) {
+            registry->overflow = NGX_HTTP_ACCOUNTING_OVERFLOW_DROP;
+
+        } else {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[2]);
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    path = value[1];
+
+    if (ngx_conf_full_name(cf->cycle, &path, 1) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    if (ngx_http_accounting_registry_load(cf, registry, &path) != NGX_OK) {
+        return NGX_CONF_ERROR;
+    }
+
+    amcf->registry = registry;
+
+    return NGX_CONF_OK;
+}
+
+
+static ngx_int_t
+ngx_http_accounting_registry_load(ngx_conf_t *cf, ngx_http_accounting_registry_t *registry,
+    ngx_str_t *path)
+{
+    u_char              *p, *last, *end;
+    size_t               size;
+    ssize_t              n;
+    uint32_t            *slots;
+    uint64_t            *hashes;
+    ngx_fd_t             fd;
+    ngx_int_t            rc;
+    ngx_str_t           *ids;
+    ngx_uint_t           i, nr_ids;
+    ngx_file_info_t      fi;
+    ngx_pool_cleanup_t  *cln;
+
+    cln = ngx_pool_cleanup_add(cf->pool, 0);
+    if (cln == NULL) {
+        return NGX_ERROR;
+    }
+
+    cln->handler = ngx_http_accounting_registry_cleanup;
+    cln->data = registry;
+
+    fd = ngx_open_file(path->data, NGX_FILE_RDONLY, NGX_FILE_OPEN, 0);
+    if (fd == NGX_INVALID_FILE) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno, ngx_open_file_n " \"%V\" failed", path);
+        return NGX_ERROR;
+    }
+
+    if (ngx_fd_info(fd, &fi) == NGX_FILE_ERROR) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno, ngx_fd_info_n " \"%V\" failed", path);
+        (void) ngx_close_file(fd);
+        return NGX_ERROR;
+    }
+
+    size = (size_t) ngx_file_size(&fi);
+
+    registry->data = ngx_alloc(size + 1, cf->log);
+    if (registry->data == NULL) {
+        (void) ngx_close_file(fd);
+        return NGX_ERROR;
+    }
+
+    for (p = registry->data; p < registry->data + size; p += n) {
+        n = ngx_read_fd(fd, p, registry->data + size - p);
+
+        if (n == -1 || n == 0) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, ngx_errno, ngx_read_fd_n " \"%V\" failed", path);
+            (void) ngx_close_file(fd);
+            return NGX_ERROR;
+        }
+    }
+
+    (void) ngx_close_file(fd);
+
+    end = registry->data + size;
+    *end = LF;
+
+    // one id per line, blank lines and lines starting with '#' are skipped
+    nr_ids = 0;
+    for (p = registry->data; p < end; p++) {
+        if (*p == LF) {
+            nr_ids++;
+        }
+    }
+    nr_ids++;
+
+    ids = ngx_alloc(nr_ids * sizeof(ngx_str_t), cf->log);
+    if (ids == NULL) {
+        return NGX_ERROR;
+    }
+
+    registry->ids = ids;
+
+    for (i = 0, p = registry->data; p < end; p = last + 1) {
+        last = ngx_strlchr(p, end + 1, LF);
+
+        while (p < last && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+
+        n = last - p;
+        while (n && (p[n - 1] == ' ' || p[n - 1] == '\t' || p[n - 1] == CR)) {
+            n--;
+        }
+
+        if (n == 0 || *p == '#') {
+            continue;
+        }
+
+        ids[i].len = n;
+        ids[i].data = p;
+        i++;
+    }
+
+    nr_ids = i;
+
+    if (nr_ids == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "no accounting ids in \"%V\"", path);
+        return NGX_ERROR;
+    }
+
+    hashes = ngx_alloc(nr_ids * sizeof(uint64_t), cf->log);
+    slots = ngx_alloc(nr_ids * sizeof(uint32_t), cf->log);
+
+    if (hashes == NULL || slots == NULL) {
+        ngx_free(hashes);
+        ngx_free(slots);
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < nr_ids; i++) {
+        hashes[i] = ngx_http_accounting_hll_hash(ids[i].data, ids[i].len);
+    }
+
+    rc = ngx_http_accounting_mph_build(&registry->mph, hashes, nr_ids, slots);
+
+    ngx_free(hashes);
+
+    if (rc != 0) {
+        ngx_free(slots);
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           rc == -2 ? "duplicate accounting ids in \"%V\""
+                                    : "could not build the hash for \"%V\"",
+                           path);
+        return NGX_ERROR;
+    }
+
+    // reorder the ids by slot, ids[] is exactly nr_ids long from now on
+    registry->ids = ngx_alloc(nr_ids * sizeof(ngx_str_t), cf->log);
+    if (registry->ids == NULL) {
+        registry->ids = ids;
+        ngx_free(slots);
+        return NGX_ERROR;
+    }
+
+    for (i = 0; i < nr_ids; i++) {
+        registry->ids[slots[i]] = ids[i];
+    }
+
+    ngx_free(ids);
+    ngx_free(slots);
+
+    return NGX_OK;
+}
+
+
+static void
+ngx_http_accounting_registry_cleanup(void *data)
+{
+    ngx_http_accounting_registry_t  *registry = data;
+
+    ngx_http_accounting_mph_free(&registry->mph);
+
+    if (registry->ids) {
+        ngx_free(registry->ids);
+    }
+
+    if (registry->data) {
+        ngx_free(registry->data);
+    }
+}
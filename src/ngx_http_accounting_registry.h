@@ -0,0 +1,41 @@
+#ifndef _NGX_HTTP_ACCOUNTING_REGISTRY_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_REGISTRY_H_INCLUDED_
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+#include "ngx_http_accounting_hll.h"
+#include "ngx_http_accounting_mph.h"
+
+
+#define NGX_HTTP_ACCOUNTING_OVERFLOW_DYNAMIC    0
+#define NGX_HTTP_ACCOUNTING_OVERFLOW_OTHER      1
+#define NGX_HTTP_ACCOUNTING_OVERFLOW_DROP       2
+
+typedef struct {
+    ngx_http_accounting_mph_t   mph;
+    ngx_str_t                  *ids;        /* by slot */
+    u_char                     *data;       /* the registry file */
+    ngx_uint_t                  overflow;
+} ngx_http_accounting_registry_t;
+
+
+char *ngx_http_accounting_registry(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+
+
+// one hash and one compare, returns the slot of a known id or NGX_ERROR
+static ngx_inline ngx_int_t
+ngx_http_accounting_registry_find(ngx_http_accounting_registry_t *registry, u_char *name, size_t len)
+{
+    uint32_t  slot;
+
+    slot = ngx_http_accounting_mph_slot(&registry->mph, ngx_http_accounting_hll_hash(name, len));
+
+    if (registry->ids[slot].len == len && ngx_memcmp(registry->ids[slot].data, name, len) == 0) {
+        return slot;
+    }
+
+    return NGX_ERROR;
+}
+
+#endif /* _NGX_HTTP_ACCOUNTING_REGISTRY_H_INCLUDED_ */
@@ -0,0 +1,30 @@
+#ifndef _NGX_HTTP_ACCOUNTING_SIZE_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_SIZE_H_INCLUDED_
+
+/*
+ * Log2 histograms of request and response sizes, as written to the lines
+ * and snapshots. Only depends on libc.
+ */
+
+#include <stdint.h>
+
+
+#define NGX_HTTP_ACCOUNTING_SIZE_BUCKETS    32
+
+
+// bucket 0 counts empty bodies, bucket n sizes in [2^(n-1), 2^n), the last one everything above
+static inline unsigned
+ngx_http_accounting_size_bucket(int64_t size)
+{
+    unsigned  n;
+
+    if (size <= 0) {
+        return 0;
+    }
+
+    n = 64 - __builtin_clzll((unsigned long long) size);
+
+    return n < NGX_HTTP_ACCOUNTING_SIZE_BUCKETS ? n : NGX_HTTP_ACCOUNTING_SIZE_BUCKETS - 1;
+}
+
+#endif /* _NGX_HTTP_ACCOUNTING_SIZE_H_INCLUDED_ */
@@ -0,0 +1,325 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_hash.h"
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_module.h"
+#include "ngx_http_accounting_slo.h"
+
+
+static ngx_str_t  ngx_http_accounting_slo_zone_name = ngx_string("http_accounting_slo");
+
+static ngx_int_t ngx_http_accounting_slo_parse_objective(u_char *data, size_t len);
+static ngx_int_t ngx_http_accounting_slo_init_zone(ngx_shm_zone_t *shm_zone, void *data);
+
+
+// http_accounting_slo id [availability=PERCENT] [latency=TIME:PERCENT];
+char *
+ngx_http_accounting_slo(ngx_conf_t *cf, ngx_command_t *cmd, void *conf)
+{
+    ngx_http_accounting_main_conf_t *amcf = conf;
+
+    u_char                     *colon;
+    ngx_str_t                  *value, s;
+    ngx_int_t                   n;
+    ngx_uint_t                  i;
+    ngx_http_accounting_slo_t  *slo;
+
+    if (amcf->slos == NULL) {
+        amcf->slos = ngx_array_create(cf->pool, 4, sizeof(ngx_http_accounting_slo_t));
+        if (amcf->slos == NULL) {
+            return NGX_CONF_ERROR;
+        }
+    }
+
+    slo = ngx_array_push(amcf->slos);
+    if (slo == NULL) {
+        return NGX_CONF_ERROR;
+    }
+
+    ngx_memzero(slo, sizeof(ngx_http_accounting_slo_t));
+
+    value = cf->args->elts;
+
+    slo->id = value[1];
+    slo->index = amcf->slos->nelts - 1;
+
+    for (i = 2; i < cf->args->nelts; i++) {
+
+        if (ngx_strncmp(value[i].data, "availability=", 13) == 0) {
+            n = ngx_http_accounting_slo_parse_objective(value[i].data + 13, value[i].len - 13);
+            if (n == NGX_ERROR) {
+                goto invalid;
+            }
+            slo->availability = n;
+            continue;
+        }
+
+        if (ngx_strncmp(value[i].data, "latency=", 8) == 0) {
+            s.data = value[i].data + 8;
+            colon = ngx_strlchr(s.data, value[i].data + value[i].len, ':');
+            if (colon == NULL) {
+                goto invalid;
+            }
+
+            s.len = colon - s.data;
+            slo->latency = ngx_parse_time(&s, 0);
+            if (slo->latency == (ngx_msec_t) NGX_ERROR || slo->latency == 0) {
+                goto invalid;
+            }
+
+            n = ngx_http_accounting_slo_parse_objective(colon + 1,
+                                                        value[i].data + value[i].len - colon - 1);
+            if (n == NGX_ERROR) {
+                goto invalid;
+            }
+            slo->latency_objective = n;
+            continue;
+        }
+
+        goto invalid;
+    }
+
+    if (slo->availability == 0 && slo->latency == 0) {
+        ngx_conf_log_error(NGX_LOG_EMERG, cf, 0,
+                           "slo \"%V\" needs \"availability\" or \"latency\"", &slo->id);
+        return NGX_CONF_ERROR;
+    }
+
+    return NGX_CONF_OK;
+
+invalid:
+
+    ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "invalid parameter \"%V\"", &value[i]);
+
+    return NGX_CONF_ERROR;
+}
+
+
+// "99.9%" is 99900, objectives of 100% leave no error budget to burn
+static ngx_int_t
+ngx_http_accounting_slo_parse_objective(u_char *data, size_t len)
+{
+    ngx_int_t  n;
+
+    if (len < 2 || data[len - 1] != '%') {
+        return NGX_ERROR;
+    }
+
+    n = ngx_atofp(data, len - 1, 3);
+    if (n <= 0 || n >= NGX_HTTP_ACCOUNTING_SLO_ONE) {
+        return NGX_ERROR;
+    }
+
+    return n;
+}
+
+
+ngx_int_t
+ngx_http_accounting_slo_init_conf(ngx_conf_t *cf)
+{
+    size_t                            size;
+    ngx_uint_t                        i, j, key;
+    ngx_shm_zone_t                   *zone;
+    ngx_http_accounting_slo_t        *slos;
+    ngx_http_accounting_main_conf_t  *amcf;
+
+    amcf = ngx_http_conf_get_module_main_conf(cf, ngx_http_accounting_module);
+
+    if (amcf->slos == NULL) {
+        return NGX_OK;
+    }
+
+    size = 8 * ngx_pagesize
+           + amcf->slos->nelts * (NGX_HTTP_ACCOUNTING_SLO_SLOTS * sizeof(ngx_http_accounting_slo_slot_t)
+                                  + sizeof(ngx_http_accounting_slo_owner_t));
+
+    zone = ngx_shared_memory_add(cf, &ngx_http_accounting_slo_zone_name, size,
+                                 &ngx_http_accounting_module);
+    if (zone == NULL) {
+        return NGX_ERROR;
+    }
+
+    zone->init = ngx_http_accounting_slo_init_zone;
+    zone->data = amcf->slos;
+
+    if (ngx_http_accounting_hash_init(&amcf->slos_hash, NGX_HTTP_ACCOUNTING_NR_BUCKETS, cf->pool)
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    slos = amcf->slos->elts;
+
+    for (i = 0; i < amcf->slos->nelts; i++) {
+        slos[i].zone = zone;
+
+        key = ngx_hash_key_lc(slos[i].id.data, slos[i].id.len);
+        slos[i].key = key;
+
+        if (ngx_http_accounting_hash_find(&amcf->slos_hash, key, slos[i].id.data, slos[i].id.len)
+            != NULL)
+        {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "duplicate slo \"%V\"", &slos[i].id);
+            return NGX_ERROR;
+        }
+
+        if (ngx_http_accounting_hash_add(&amcf->slos_hash, key, slos[i].id.data,
+                                         slos[i].id.len, &slos[i])
+            != NGX_OK)
+        {
+            return NGX_ERROR;
+        }
+
+        if (slos[i].latency == 0) {
+            continue;
+        }
+
+        // entries count slow requests once per distinct latency, not per SLO
+        for (j = 0; j < amcf->nr_slo_latencies; j++) {
+            if (amcf->slo_latencies[j] == slos[i].latency) {
+                break;
+            }
+        }
+
+        if (j == NGX_HTTP_ACCOUNTING_SLO_MAX_LATENCIES) {
+            ngx_conf_log_error(NGX_LOG_EMERG, cf, 0, "at most %d different slo latencies",
+                               NGX_HTTP_ACCOUNTING_SLO_MAX_LATENCIES);
+            return NGX_ERROR;
+        }
+
+        if (j == amcf->nr_slo_latencies) {
+            amcf->slo_latencies[amcf->nr_slo_latencies++] = slos[i].latency;
+        }
+
+        slos[i].latency_index = j;
+    }
+
+    return NGX_OK;
+}
+
+
+/*
+ * The zone is reused across a reload as long as its size, and so the number
+ * of SLOs, stays the same. The burn windows of an SLO are kept as long as its
+ * id and latency are, a ring that now belongs to another one starts over.
+ */
+static ngx_int_t
+ngx_http_accounting_slo_init_zone(ngx_shm_zone_t *shm_zone, void *data)
+{
+    size_t                            size;
+    ngx_uint_t                        i;
+    ngx_array_t                      *slos = shm_zone->data;
+    ngx_slab_pool_t                  *shpool;
+    ngx_http_accounting_slo_t        *slo;
+    ngx_http_accounting_slo_slot_t   *slots;
+    ngx_http_accounting_slo_owner_t  *owners;
+
+    size = slos->nelts * NGX_HTTP_ACCOUNTING_SLO_SLOTS * sizeof(ngx_http_accounting_slo_slot_t);
+
+    if (data) {
+        slots = data;
+
+    } else {
+        shpool = (ngx_slab_pool_t *) shm_zone->shm.addr;
+
+        slots = ngx_slab_alloc(shpool, size + slos->nelts * sizeof(ngx_http_accounting_slo_owner_t));
+        if (slots == NULL) {
+            return NGX_ERROR;
+        }
+
+        ngx_memzero(slots, size + slos->nelts * sizeof(ngx_http_accounting_slo_owner_t));
+    }
+
+    owners = (ngx_http_accounting_slo_owner_t *) ((u_char *) slots + size);
+    slo = slos->elts;
+
+    for (i = 0; i < slos->nelts; i++) {
+        if (owners[i].key != slo[i].key || owners[i].latency != slo[i].latency) {
+            ngx_memzero(slots + i * NGX_HTTP_ACCOUNTING_SLO_SLOTS,
+                        NGX_HTTP_ACCOUNTING_SLO_SLOTS * sizeof(ngx_http_accounting_slo_slot_t));
+            owners[i].key = slo[i].key;
+            owners[i].latency = slo[i].latency;
+        }
+    }
+
+    shm_zone->data = slots;
+
+    return NGX_OK;
+}
+
+
+ngx_http_accounting_slo_t *
+ngx_http_accounting_slo_find(ngx_http_accounting_main_conf_t *amcf, ngx_uint_t key, ngx_str_t *id)
+{
+    if (amcf->slos == NULL) {
+        return NULL;
+    }
+
+    return ngx_http_accounting_hash_find(&amcf->slos_hash, key, id->data, id->len);
+}
+
+
+/*
+ * Adds what a worker counted for the subtree of the SLO since its previous
+ * flush to the current minute, so that requests only touch worker memory.
+ */
+void
+ngx_http_accounting_slo_add(ngx_http_accounting_slo_t *slo, time_t now, ngx_uint_t requests,
+    ngx_uint_t errors, ngx_uint_t slow)
+{
+    ngx_atomic_uint_t                minute, old;
+    ngx_http_accounting_slo_slot_t  *slot;
+
+    minute = ngx_http_accounting_slo_minute(now);
+
+    slot = ngx_http_accounting_slo_slot((ngx_http_accounting_slo_slot_t *) slo->zone->data
+                                        + slo->index * NGX_HTTP_ACCOUNTING_SLO_SLOTS, minute);
+
+    // the first worker to see a new minute resets its slot; counts racing
+    // with the reset may be lost
+    old = slot->minute;
+
+    if (old != minute && ngx_atomic_cmp_set(&slot->minute, old, minute)) {
+        slot->requests = 0;
+        slot->errors = 0;
+        slot->slow = 0;
+    }
+
+    (void) ngx_atomic_fetch_add(&slot->requests, requests);
+
+    if (errors) {
+        (void) ngx_atomic_fetch_add(&slot->errors, errors);
+    }
+
+    if (slow) {
+        (void) ngx_atomic_fetch_add(&slot->slow, slow);
+    }
+}
+
+
+// burn rates over the last minutes, the current one included, 0 for objectives not set
+void
+ngx_http_accounting_slo_burn(ngx_http_accounting_slo_t *slo, time_t now, ngx_uint_t minutes,
+    double *availability, double *latency)
+{
+    ngx_http_accounting_slo_sums_t  sums;
+
+    ngx_http_accounting_slo_window((ngx_http_accounting_slo_slot_t *) slo->zone->data
+                                   + slo->index * NGX_HTTP_ACCOUNTING_SLO_SLOTS,
+                                   ngx_http_accounting_slo_minute(now), minutes, &sums);
+
+    *availability = 0;
+    *latency = 0;
+
+    if (slo->availability) {
+        *availability = ngx_http_accounting_slo_burn_rate(sums.errors, sums.requests,
+                                                          slo->availability);
+    }
+
+    if (slo->latency) {
+        *latency = ngx_http_accounting_slo_burn_rate(sums.slow, sums.requests,
+                                                     slo->latency_objective);
+    }
+}
@@ -0,0 +1,40 @@
+#ifndef _NGX_HTTP_ACCOUNTING_SLO_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_SLO_H_INCLUDED_
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_http.h>
+
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_module.h"
+#include "ngx_http_accounting_slo_window.h"
+
+
+// the SLO a ring belongs to, kept after the rings so that they survive reloads
+typedef struct {
+    ngx_uint_t       key;
+    ngx_msec_t       latency;
+} ngx_http_accounting_slo_owner_t;
+
+struct ngx_http_accounting_slo_s {
+    ngx_str_t        id;
+    ngx_uint_t       key;
+    ngx_uint_t       availability;  /* objective for non 5xx responses */
+    ngx_msec_t       latency;
+    ngx_uint_t       latency_index; /* of the slow counters of the entries */
+    ngx_uint_t       latency_objective;  /* objective for responses within latency */
+    ngx_uint_t       index;
+    ngx_shm_zone_t  *zone;
+};
+
+char *ngx_http_accounting_slo(ngx_conf_t *cf, ngx_command_t *cmd, void *conf);
+ngx_int_t ngx_http_accounting_slo_init_conf(ngx_conf_t *cf);
+
+ngx_http_accounting_slo_t *ngx_http_accounting_slo_find(
+                ngx_http_accounting_main_conf_t *amcf, ngx_uint_t key, ngx_str_t *id);
+void ngx_http_accounting_slo_add(ngx_http_accounting_slo_t *slo, time_t now,
+                ngx_uint_t requests, ngx_uint_t errors, ngx_uint_t slow);
+void ngx_http_accounting_slo_burn(ngx_http_accounting_slo_t *slo, time_t now, ngx_uint_t minutes,
+                double *availability, double *latency);
+
+#endif /* _NGX_HTTP_ACCOUNTING_SLO_H_INCLUDED_ */
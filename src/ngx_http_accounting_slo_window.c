@@ -0,0 +1,45 @@
+#include <string.h>
+
+#include "ngx_http_accounting_slo_window.h"
+
+
+// sums the last minutes up to minute, the current one included
+void
+ngx_http_accounting_slo_window(ngx_http_accounting_slo_slot_t *slots, uint64_t minute,
+    unsigned minutes, ngx_http_accounting_slo_sums_t *sums)
+{
+    unsigned                         i;
+    ngx_http_accounting_slo_slot_t  *slot;
+
+    memset(sums, 0, sizeof(ngx_http_accounting_slo_sums_t));
+
+    for (i = 0; i < minutes && i < NGX_HTTP_ACCOUNTING_SLO_SLOTS && i < minute; i++) {
+        slot = ngx_http_accounting_slo_slot(slots, minute - i);
+
+        // slots not written to since their minute came around are stale
+        if (slot->minute != minute - i) {
+            continue;
+        }
+
+        sums->requests += slot->requests;
+        sums->errors += slot->errors;
+        sums->slow += slot->slow;
+    }
+}
+
+
+/*
+ * The share of bad requests divided by the share the objective allows: 1
+ * spends the error budget exactly over the SLO period, 0 when there were no
+ * requests.
+ */
+double
+ngx_http_accounting_slo_burn_rate(uint64_t bad, uint64_t requests, unsigned objective)
+{
+    if (requests == 0) {
+        return 0;
+    }
+
+    return (double) bad * NGX_HTTP_ACCOUNTING_SLO_ONE
+           / ((double) requests * (NGX_HTTP_ACCOUNTING_SLO_ONE - objective));
+}
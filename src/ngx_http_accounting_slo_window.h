@@ -0,0 +1,63 @@
+#ifndef _NGX_HTTP_ACCOUNTING_SLO_WINDOW_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_SLO_WINDOW_H_INCLUDED_
+
+/*
+ * The per-minute ring of an SLO and its burn rates. Slots are shared by all
+ * workers and counted with atomics in ngx_http_accounting_slo.c, the window
+ * math here builds with libc only for the tests.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+#ifndef TESTING
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+typedef ngx_atomic_t  ngx_http_accounting_slo_counter_t;
+#else
+typedef volatile unsigned long  ngx_http_accounting_slo_counter_t;
+#endif
+
+
+// one slot per minute, enough for the longest burn rate window
+#define NGX_HTTP_ACCOUNTING_SLO_SLOTS       360
+
+// objectives are stored in 1/100000, i.e. thousandths of a percent
+#define NGX_HTTP_ACCOUNTING_SLO_ONE         100000
+
+// a slot is reused once its minute is 6 hours old
+typedef struct {
+    ngx_http_accounting_slo_counter_t  minute;
+    ngx_http_accounting_slo_counter_t  requests;
+    ngx_http_accounting_slo_counter_t  errors;
+    ngx_http_accounting_slo_counter_t  slow;
+} ngx_http_accounting_slo_slot_t;
+
+typedef struct {
+    uint64_t     requests;
+    uint64_t     errors;
+    uint64_t     slow;
+} ngx_http_accounting_slo_sums_t;
+
+
+// minutes start at 1, so that a zeroed slot is never part of a window
+static inline uint64_t
+ngx_http_accounting_slo_minute(time_t now)
+{
+    return (uint64_t) now / 60 + 1;
+}
+
+
+static inline ngx_http_accounting_slo_slot_t *
+ngx_http_accounting_slo_slot(ngx_http_accounting_slo_slot_t *slots, uint64_t minute)
+{
+    return &slots[minute % NGX_HTTP_ACCOUNTING_SLO_SLOTS];
+}
+
+
+void ngx_http_accounting_slo_window(ngx_http_accounting_slo_slot_t *slots, uint64_t minute,
+    unsigned minutes, ngx_http_accounting_slo_sums_t *sums);
+double ngx_http_accounting_slo_burn_rate(uint64_t bad, uint64_t requests, unsigned objective);
+
+#endif /* _NGX_HTTP_ACCOUNTING_SLO_WINDOW_H_INCLUDED_ */
@@ -0,0 +1,229 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+#include "ngx_http_accounting_common.h"
+#include "ngx_http_accounting_snapshot.h"
+#include "ngx_http_accounting_snapshot_format.h"
+
+
+typedef struct {
+    uint32_t     kind;
+    size_t       offset;
+} ngx_http_accounting_snapshot_counter_t;
+
+static ngx_http_accounting_snapshot_counter_t  ngx_http_accounting_snapshot_counters[] = {
+    { NGX_HTTP_ACCOUNTING_COL_REQUESTS,
+      offsetof(ngx_http_accounting_stats_t, nr_requests) },
+    { NGX_HTTP_ACCOUNTING_COL_BYTES_IN,
+      offsetof(ngx_http_accounting_stats_t, bytes_in) },
+    { NGX_HTTP_ACCOUNTING_COL_BYTES_OUT,
+      offsetof(ngx_http_accounting_stats_t, bytes_out) },
+    { NGX_HTTP_ACCOUNTING_COL_LATENCY_MS,
+      offsetof(ngx_http_accounting_stats_t, total_latency_ms) },
+    { NGX_HTTP_ACCOUNTING_COL_UPSTREAM_LATENCY_MS,
+      offsetof(ngx_http_accounting_stats_t, upstream_total_latency_ms) },
+    { NGX_HTTP_ACCOUNTING_COL_UPSTREAM_CONNECT_MS,
+      offsetof(ngx_http_accounting_stats_t, upstream_connect_ms) },
+    { NGX_HTTP_ACCOUNTING_COL_UPSTREAM_HEADER_MS,
+      offsetof(ngx_http_accounting_stats_t, upstream_header_ms) },
+    { NGX_HTTP_ACCOUNTING_COL_UPSTREAM_ATTEMPTS,
+      offsetof(ngx_http_accounting_stats_t, upstream_attempts) },
+    { NGX_HTTP_ACCOUNTING_COL_UPSTREAM_RETRIES,
+      offsetof(ngx_http_accounting_stats_t, upstream_retries) },
+    { NGX_HTTP_ACCOUNTING_COL_UPSTREAM_ERRORS,
+      offsetof(ngx_http_accounting_stats_t, upstream_errors) },
+    { NGX_HTTP_ACCOUNTING_COL_SAMPLED,
+      offsetof(ngx_http_accounting_stats_t, nr_sampled) },
+    { NGX_HTTP_ACCOUNTING_COL_IN_FLIGHT,
+      offsetof(ngx_http_accounting_stats_t, in_flight) },
+    { NGX_HTTP_ACCOUNTING_COL_MAX_IN_FLIGHT,
+      offsetof(ngx_http_accounting_stats_t, max_in_flight) },
+    { NGX_HTTP_ACCOUNTING_COL_CPU_NS,
+      offsetof(ngx_http_accounting_stats_t, cpu_ns) },
+};
+
+#define NGX_HTTP_ACCOUNTING_SNAPSHOT_NR_COUNTERS                                  \
+    (sizeof(ngx_http_accounting_snapshot_counters)                                \
+     / sizeof(ngx_http_accounting_snapshot_counter_t))
+
+#define NGX_HTTP_ACCOUNTING_SNAPSHOT_MAX_COLUMNS                                  \
+    (NGX_HTTP_ACCOUNTING_SNAPSHOT_NR_COUNTERS + 3 + NGX_HTTP_ACCOUNTING_MAX_DISTINCT)
+
+
+static ngx_int_t ngx_http_accounting_snapshot_save(ngx_log_t *log, u_char *tmp, u_char *name,
+    u_char *buf, size_t size);
+
+
+// entries must be sorted with ngx_http_accounting_snapshot_name_cmp()
+ngx_int_t
+ngx_http_accounting_snapshot_write(ngx_log_t *log, ngx_str_t *dir, time_t from, time_t to,
+    ngx_http_accounting_stats_t **entries, ngx_uint_t n)
+{
+    u_char                                 *buf, *names, *p;
+    size_t                                  size;
+    uint64_t                               *row;
+    ngx_int_t                               rc;
+    ngx_uint_t                              i, j, k, classes[10];
+    ngx_http_accounting_stats_t            *stats;
+    ngx_http_accounting_snapshot_id_t      *ids;
+    ngx_http_accounting_snapshot_header_t   header;
+    ngx_http_accounting_snapshot_column_t   columns[NGX_HTTP_ACCOUNTING_SNAPSHOT_MAX_COLUMNS];
+    u_char                                  tmp[NGX_MAX_PATH], name[NGX_MAX_PATH];
+
+    ngx_memzero(&header, sizeof(header));
+    ngx_memzero(columns, sizeof(columns));
+
+    header.from = from;
+    header.to = to;
+    header.pid = ngx_getpid();
+    header.nr_ids = n;
+
+    for (i = 0; i < n; i++) {
+        header.names_size += entries[i]->name.len;
+    }
+
+    for (j = 0; j < NGX_HTTP_ACCOUNTING_SNAPSHOT_NR_COUNTERS; j++) {
+        columns[j].kind = ngx_http_accounting_snapshot_counters[j].kind;
+        columns[j].merge = NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM;
+        columns[j].elem_size = sizeof(uint64_t);
+        columns[j].width = 1;
+    }
+
+    columns[j].kind = NGX_HTTP_ACCOUNTING_COL_STATUS_CLASSES;
+    columns[j].merge = NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM;
+    columns[j].elem_size = sizeof(uint64_t);
+    columns[j].width = 10;
+
+    j++;
+    columns[j].kind = NGX_HTTP_ACCOUNTING_COL_SIZE_IN;
+    columns[j].merge = NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM;
+    columns[j].elem_size = sizeof(uint64_t);
+    columns[j].width = NGX_HTTP_ACCOUNTING_SIZE_BUCKETS;
+
+    j++;
+    columns[j].kind = NGX_HTTP_ACCOUNTING_COL_SIZE_OUT;
+    columns[j].merge = NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM;
+    columns[j].elem_size = sizeof(uint64_t);
+    columns[j].width = NGX_HTTP_ACCOUNTING_SIZE_BUCKETS;
+
+    for (k = 0; k < ngx_http_accounting_nr_distincts; k++) {
+        j++;
+        columns[j].kind = NGX_HTTP_ACCOUNTING_COL_DISTINCT + k;
+        columns[j].merge = NGX_HTTP_ACCOUNTING_SNAPSHOT_MAX;
+        columns[j].elem_size = 1;
+        columns[j].width = 1 << ngx_http_accounting_distincts[k].precision;
+    }
+
+    header.nr_columns = ++j;
+
+    size = ngx_http_accounting_snapshot_layout(NULL, &header, columns);
+
+    buf = ngx_alloc(size, log);
+    if (buf == NULL) {
+        return NGX_ERROR;
+    }
+
+    (void) ngx_http_accounting_snapshot_layout(buf, &header, columns);
+
+    ids = (ngx_http_accounting_snapshot_id_t *) (buf + header.ids_offset);
+    names = buf + header.names_offset;
+    p = names;
+
+    for (i = 0; i < n; i++) {
+        stats = entries[i];
+
+        ids[i].name_offset = p - names;
+        ids[i].name_len = stats->name.len;
+        ids[i].level = stats->level;
+        p = ngx_cpymem(p, stats->name.data, stats->name.len);
+
+        for (j = 0; j < NGX_HTTP_ACCOUNTING_SNAPSHOT_NR_COUNTERS; j++) {
+            row = (uint64_t *) (buf + columns[j].offset);
+            row[i] = *(ngx_uint_t *) ((u_char *) stats + ngx_http_accounting_snapshot_counters[j].offset);
+        }
+
+        ngx_http_accounting_stats_status_classes(stats, classes);
+
+        row = (uint64_t *) (buf + columns[j].offset) + i * 10;
+        for (k = 0; k < 10; k++) {
+            row[k] = classes[k];
+        }
+
+        j++;
+        row = (uint64_t *) (buf + columns[j].offset) + i * NGX_HTTP_ACCOUNTING_SIZE_BUCKETS;
+        for (k = 0; k < NGX_HTTP_ACCOUNTING_SIZE_BUCKETS; k++) {
+            row[k] = stats->size_in[k];
+        }
+
+        j++;
+        row = (uint64_t *) (buf + columns[j].offset) + i * NGX_HTTP_ACCOUNTING_SIZE_BUCKETS;
+        for (k = 0; k < NGX_HTTP_ACCOUNTING_SIZE_BUCKETS; k++) {
+            row[k] = stats->size_out[k];
+        }
+
+        for (k = 0; k < ngx_http_accounting_nr_distincts; k++) {
+            j++;
+            ngx_memcpy(buf + columns[j].offset + i * columns[j].width, stats->distinct[k],
+                       columns[j].width);
+        }
+    }
+
+    // written under a temporary name and renamed, readers never see partial files
+    if (ngx_snprintf(tmp, NGX_MAX_PATH, "%V/.%T-%P.acct.tmp%Z", dir, to, ngx_getpid())
+            == tmp + NGX_MAX_PATH
+        || ngx_snprintf(name, NGX_MAX_PATH, "%V/%T-%P.acct%Z", dir, to, ngx_getpid())
+            == name + NGX_MAX_PATH)
+    {
+        ngx_log_error(NGX_LOG_ALERT, log, 0, "accounting snapshot path \"%V\" is too long", dir);
+        ngx_free(buf);
+        return NGX_ERROR;
+    }
+
+    rc = ngx_http_accounting_snapshot_save(log, tmp, name, buf, size);
+
+    ngx_free(buf);
+
+    return rc;
+}
+
+
+static ngx_int_t
+ngx_http_accounting_snapshot_save(ngx_log_t *log, u_char *tmp, u_char *name, u_char *buf,
+    size_t size)
+{
+    ssize_t    n;
+    ngx_fd_t   fd;
+
+    fd = ngx_open_file(tmp, NGX_FILE_WRONLY, NGX_FILE_TRUNCATE, NGX_FILE_DEFAULT_ACCESS);
+    if (fd == NGX_INVALID_FILE) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, ngx_open_file_n " \"%s\" failed", tmp);
+        return NGX_ERROR;
+    }
+
+    while (size) {
+        n = ngx_write_fd(fd, buf, size);
+
+        if (n == -1) {
+            ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, ngx_write_fd_n " \"%s\" failed", tmp);
+            (void) ngx_close_file(fd);
+            (void) ngx_delete_file(tmp);
+            return NGX_ERROR;
+        }
+
+        buf += n;
+        size -= n;
+    }
+
+    if (ngx_close_file(fd) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno, ngx_close_file_n " \"%s\" failed", tmp);
+    }
+
+    if (ngx_rename_file(tmp, name) == NGX_FILE_ERROR) {
+        ngx_log_error(NGX_LOG_ALERT, log, ngx_errno,
+                      ngx_rename_file_n " \"%s\" to \"%s\" failed", tmp, name);
+        (void) ngx_delete_file(tmp);
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
@@ -0,0 +1,13 @@
+#ifndef _NGX_HTTP_ACCOUNTING_SNAPSHOT_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_SNAPSHOT_H_INCLUDED_
+
+#include <ngx_config.h>
+#include <ngx_core.h>
+
+#include "ngx_http_accounting_common.h"
+
+
+ngx_int_t ngx_http_accounting_snapshot_write(ngx_log_t *log, ngx_str_t *dir,
+                time_t from, time_t to, ngx_http_accounting_stats_t **entries, ngx_uint_t n);
+
+#endif /* _NGX_HTTP_ACCOUNTING_SNAPSHOT_H_INCLUDED_ */
@@ -0,0 +1,137 @@
+#include <string.h>
+
+#include "ngx_http_accounting_snapshot_format.h"
+
+
+#define snapshot_align(n)  (((n) + 7) & ~((uint64_t) 7))
+
+
+/*
+ * Computes the offsets of a snapshot described by header->nr_ids,
+ * header->nr_columns, header->names_size and the columns' element sizes and
+ * widths. Returns the file size. With a buffer, the header and column
+ * descriptors are written to it and the rest of the buffer is zeroed.
+ */
+size_t
+ngx_http_accounting_snapshot_layout(void *buf, ngx_http_accounting_snapshot_header_t *header,
+    ngx_http_accounting_snapshot_column_t *columns)
+{
+    uint32_t  i;
+    uint64_t  offset;
+
+    offset = snapshot_align(sizeof(ngx_http_accounting_snapshot_header_t));
+    offset += snapshot_align(header->nr_columns * sizeof(ngx_http_accounting_snapshot_column_t));
+
+    header->ids_offset = offset;
+    offset += snapshot_align((uint64_t) header->nr_ids * sizeof(ngx_http_accounting_snapshot_id_t));
+
+    header->names_offset = offset;
+    offset += snapshot_align(header->names_size);
+
+    for (i = 0; i < header->nr_columns; i++) {
+        columns[i].reserved = 0;
+        columns[i].offset = offset;
+        offset += snapshot_align((uint64_t) header->nr_ids * columns[i].width * columns[i].elem_size);
+    }
+
+    memcpy(header->magic, NGX_HTTP_ACCOUNTING_SNAPSHOT_MAGIC, sizeof(header->magic));
+    header->version = NGX_HTTP_ACCOUNTING_SNAPSHOT_VERSION;
+    header->header_size = sizeof(ngx_http_accounting_snapshot_header_t);
+    header->reserved = 0;
+    header->file_size = offset;
+
+    if (buf != NULL) {
+        memset(buf, 0, offset);
+        memcpy(buf, header, sizeof(ngx_http_accounting_snapshot_header_t));
+        memcpy((unsigned char *) buf + snapshot_align(sizeof(ngx_http_accounting_snapshot_header_t)),
+               columns, header->nr_columns * sizeof(ngx_http_accounting_snapshot_column_t));
+    }
+
+    return offset;
+}
+
+
+/*
+ * Validates a snapshot image, e.g. an mmap()ed file, and sets up the view.
+ * Returns 0 on success and -1 if the image is truncated or malformed.
+ */
+int
+ngx_http_accounting_snapshot_open(ngx_http_accounting_snapshot_t *snap, const void *buf,
+    size_t len)
+{
+    uint32_t   i;
+    uint64_t   end;
+    const ngx_http_accounting_snapshot_header_t  *h = buf;
+    const ngx_http_accounting_snapshot_column_t  *c;
+    const ngx_http_accounting_snapshot_id_t      *id;
+
+    if (len < sizeof(ngx_http_accounting_snapshot_header_t)
+        || memcmp(h->magic, NGX_HTTP_ACCOUNTING_SNAPSHOT_MAGIC, sizeof(h->magic)) != 0
+        || h->version != NGX_HTTP_ACCOUNTING_SNAPSHOT_VERSION
+        || h->header_size < sizeof(ngx_http_accounting_snapshot_header_t)
+        || h->file_size > len)
+    {
+        return -1;
+    }
+
+    if (snapshot_align(h->header_size) + (uint64_t) h->nr_columns * sizeof(*c) > h->ids_offset
+        || h->ids_offset + (uint64_t) h->nr_ids * sizeof(*id) > h->names_offset
+        || h->names_offset + h->names_size > h->file_size)
+    {
+        return -1;
+    }
+
+    snap->header = h;
+    snap->base = buf;
+    snap->columns = (const void *) (snap->base + snapshot_align(h->header_size));
+    snap->ids = (const void *) (snap->base + h->ids_offset);
+    snap->names = (const char *) snap->base + h->names_offset;
+
+    for (i = 0; i < h->nr_columns; i++) {
+        c = &snap->columns[i];
+        end = c->offset + (uint64_t) h->nr_ids * c->width * c->elem_size;
+
+        if ((c->offset & 7) || end > h->file_size
+            || (c->elem_size != 1 && c->elem_size != 2 && c->elem_size != 4 && c->elem_size != 8))
+        {
+            return -1;
+        }
+    }
+
+    for (i = 0; i < h->nr_ids; i++) {
+        if (snap->ids[i].name_offset + snap->ids[i].name_len > h->names_size) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+
+int
+ngx_http_accounting_snapshot_find_column(ngx_http_accounting_snapshot_t *snap, uint32_t kind)
+{
+    uint32_t  i;
+
+    for (i = 0; i < snap->header->nr_columns; i++) {
+        if (snap->columns[i].kind == kind) {
+            return (int) i;
+        }
+    }
+
+    return -1;
+}
+
+
+int
+ngx_http_accounting_snapshot_name_cmp(const char *a, size_t alen, const char *b, size_t blen)
+{
+    int  rc;
+
+    rc = memcmp(a, b, alen < blen ? alen : blen);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return (alen > blen) - (alen < blen);
+}
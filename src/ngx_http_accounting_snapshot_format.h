@@ -0,0 +1,117 @@
+#ifndef _NGX_HTTP_ACCOUNTING_SNAPSHOT_FORMAT_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_SNAPSHOT_FORMAT_H_INCLUDED_
+
+/*
+ * Binary snapshot of one accounting interval, shared by the module and the
+ * standalone tools, so it only depends on libc.
+ *
+ * Layout, every offset is absolute and 8 byte aligned, host byte order:
+ *
+ *   header
+ *   column descriptors      nr_columns
+ *   ids                     nr_ids, sorted by name (memcmp, shorter first)
+ *   names                   names_size bytes, not NUL terminated
+ *   column data             per column: nr_ids rows of width elements
+ *
+ * Readers must skip columns of unknown kind, merging keeps them as long as
+ * their merge operation is known.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define NGX_HTTP_ACCOUNTING_SNAPSHOT_MAGIC      "NGXACCT"
+#define NGX_HTTP_ACCOUNTING_SNAPSHOT_VERSION    1
+
+#define NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM        1
+#define NGX_HTTP_ACCOUNTING_SNAPSHOT_MAX        2
+
+#define NGX_HTTP_ACCOUNTING_COL_REQUESTS            1
+#define NGX_HTTP_ACCOUNTING_COL_BYTES_IN            2
+#define NGX_HTTP_ACCOUNTING_COL_BYTES_OUT           3
+#define NGX_HTTP_ACCOUNTING_COL_LATENCY_MS          4
+#define NGX_HTTP_ACCOUNTING_COL_UPSTREAM_LATENCY_MS 5
+#define NGX_HTTP_ACCOUNTING_COL_UPSTREAM_CONNECT_MS 6
+#define NGX_HTTP_ACCOUNTING_COL_UPSTREAM_HEADER_MS  7
+#define NGX_HTTP_ACCOUNTING_COL_UPSTREAM_ATTEMPTS   8
+#define NGX_HTTP_ACCOUNTING_COL_UPSTREAM_RETRIES    9
+#define NGX_HTTP_ACCOUNTING_COL_UPSTREAM_ERRORS     10
+#define NGX_HTTP_ACCOUNTING_COL_STATUS_CLASSES      11  /* width 10, [n] is nxx, [9] is 499 */
+#define NGX_HTTP_ACCOUNTING_COL_SAMPLED             12  /* requests of the sampled dimensions */
+#define NGX_HTTP_ACCOUNTING_COL_SIZE_IN             13  /* width 32, log2 buckets of request sizes */
+#define NGX_HTTP_ACCOUNTING_COL_SIZE_OUT            14  /* width 32, log2 buckets of response sizes */
+#define NGX_HTTP_ACCOUNTING_COL_IN_FLIGHT           15  /* running requests at the end */
+#define NGX_HTTP_ACCOUNTING_COL_MAX_IN_FLIGHT       16  /* peak, merged snapshots hold the sum of peaks */
+#define NGX_HTTP_ACCOUNTING_COL_CPU_NS              17  /* worker time attributed to the id */
+#define NGX_HTTP_ACCOUNTING_COL_DISTINCT            64  /* + n for the nth sketch, hll registers */
+
+typedef struct {
+    char         magic[8];
+    uint32_t     version;
+    uint32_t     header_size;
+    uint64_t     from;
+    uint64_t     to;
+    uint32_t     pid;
+    uint32_t     nr_ids;
+    uint32_t     nr_columns;
+    uint32_t     reserved;
+    uint64_t     ids_offset;
+    uint64_t     names_offset;
+    uint64_t     names_size;
+    uint64_t     file_size;
+} ngx_http_accounting_snapshot_header_t;
+
+typedef struct {
+    uint32_t     kind;
+    uint16_t     merge;
+    uint16_t     elem_size;     /* 1, 2, 4 or 8 */
+    uint32_t     width;         /* elements per id */
+    uint32_t     reserved;
+    uint64_t     offset;
+} ngx_http_accounting_snapshot_column_t;
+
+typedef struct {
+    uint64_t     name_offset;   /* relative to names_offset */
+    uint32_t     name_len;
+    uint32_t     level;
+} ngx_http_accounting_snapshot_id_t;
+
+typedef struct {
+    const ngx_http_accounting_snapshot_header_t  *header;
+    const ngx_http_accounting_snapshot_column_t  *columns;
+    const ngx_http_accounting_snapshot_id_t      *ids;
+    const char                                   *names;
+    const unsigned char                          *base;
+} ngx_http_accounting_snapshot_t;
+
+
+size_t ngx_http_accounting_snapshot_layout(void *buf,
+    ngx_http_accounting_snapshot_header_t *header,
+    ngx_http_accounting_snapshot_column_t *columns);
+int ngx_http_accounting_snapshot_open(ngx_http_accounting_snapshot_t *snap,
+    const void *buf, size_t len);
+int ngx_http_accounting_snapshot_find_column(ngx_http_accounting_snapshot_t *snap,
+    uint32_t kind);
+int ngx_http_accounting_snapshot_name_cmp(const char *a, size_t alen,
+    const char *b, size_t blen);
+
+
+static inline const char *
+ngx_http_accounting_snapshot_name(ngx_http_accounting_snapshot_t *snap, uint32_t i,
+    size_t *len)
+{
+    *len = snap->ids[i].name_len;
+    return snap->names + snap->ids[i].name_offset;
+}
+
+static inline void *
+ngx_http_accounting_snapshot_row(ngx_http_accounting_snapshot_t *snap, uint32_t col,
+    uint32_t i)
+{
+    const ngx_http_accounting_snapshot_column_t  *c = &snap->columns[col];
+
+    return (void *) (snap->base + c->offset + (uint64_t) i * c->width * c->elem_size);
+}
+
+#endif /* _NGX_HTTP_ACCOUNTING_SNAPSHOT_FORMAT_H_INCLUDED_ */
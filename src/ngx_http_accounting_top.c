@@ -0,0 +1,97 @@
+#include <string.h>
+
+#include "ngx_http_accounting_top.h"
+
+
+static void
+top_sift_down(ngx_http_accounting_top_entry_t *e, unsigned n, unsigned i)
+{
+    unsigned                         child;
+    ngx_http_accounting_top_entry_t  tmp;
+
+    tmp = e[i];
+
+    for ( ;; ) {
+        child = 2 * i + 1;
+
+        if (child >= n) {
+            break;
+        }
+
+        if (child + 1 < n && e[child + 1].key < e[child].key) {
+            child++;
+        }
+
+        if (tmp.key <= e[child].key) {
+            break;
+        }
+
+        e[i] = e[child];
+        i = child;
+    }
+
+    e[i] = tmp;
+}
+
+
+// entries that ngx_http_accounting_top_admits() turns down are ignored
+void
+ngx_http_accounting_top_add(ngx_http_accounting_top_t *top,
+    const ngx_http_accounting_top_entry_t *entry)
+{
+    unsigned                          i, parent;
+    ngx_http_accounting_top_entry_t  *e = top->entries;
+
+    if (top->n < top->k) {
+        // sift up from the new leaf
+        for (i = top->n++; i > 0; i = parent) {
+            parent = (i - 1) / 2;
+
+            if (e[parent].key <= entry->key) {
+                break;
+            }
+
+            e[i] = e[parent];
+        }
+
+        e[i] = *entry;
+        return;
+    }
+
+    if (top->k == 0 || entry->key <= e[0].key) {
+        return;
+    }
+
+    e[0] = *entry;
+    top_sift_down(e, top->n, 0);
+}
+
+
+void
+ngx_http_accounting_top_merge(ngx_http_accounting_top_t *dst, const ngx_http_accounting_top_t *src)
+{
+    unsigned  i;
+
+    for (i = 0; i < src->n; i++) {
+        if (ngx_http_accounting_top_admits(dst, src->entries[i].key)) {
+            ngx_http_accounting_top_add(dst, &src->entries[i]);
+        }
+    }
+}
+
+
+// largest key first, the entries are no heap anymore afterwards
+void
+ngx_http_accounting_top_sort(ngx_http_accounting_top_t *top)
+{
+    unsigned                          n;
+    ngx_http_accounting_top_entry_t   tmp, *e = top->entries;
+
+    // heap sort of a min-heap leaves the entries in descending order
+    for (n = top->n; n > 1; n--) {
+        tmp = e[0];
+        e[0] = e[n - 1];
+        e[n - 1] = tmp;
+        top_sift_down(e, n - 1, 0);
+    }
+}
@@ -0,0 +1,46 @@
+#ifndef _NGX_HTTP_ACCOUNTING_TOP_H_INCLUDED_
+#define _NGX_HTTP_ACCOUNTING_TOP_H_INCLUDED_
+
+/*
+ * The k requests with the largest key of an interval, kept in a min-heap:
+ * the root is the smallest one kept, so a request that does not make it
+ * costs one compare and one that does O(log k). Only depends on libc.
+ */
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+#define NGX_HTTP_ACCOUNTING_TOP_MAX         64
+#define NGX_HTTP_ACCOUNTING_TOP_URI_LEN     64      /* longer URIs are cut */
+
+typedef struct {
+    uint64_t     key;
+    uint64_t     latency_ms;
+    uint64_t     upstream_ms;
+    uint64_t     bytes;
+    uint16_t     status;
+    uint16_t     uri_len;
+    char         uri[NGX_HTTP_ACCOUNTING_TOP_URI_LEN];
+} ngx_http_accounting_top_entry_t;
+
+typedef struct {
+    unsigned                          k;
+    unsigned                          n;
+    ngx_http_accounting_top_entry_t  *entries;
+} ngx_http_accounting_top_t;
+
+
+static inline int
+ngx_http_accounting_top_admits(const ngx_http_accounting_top_t *top, uint64_t key)
+{
+    return top->n < top->k || key > top->entries[0].key;
+}
+
+void ngx_http_accounting_top_add(ngx_http_accounting_top_t *top,
+    const ngx_http_accounting_top_entry_t *entry);
+void ngx_http_accounting_top_merge(ngx_http_accounting_top_t *dst,
+    const ngx_http_accounting_top_t *src);
+void ngx_http_accounting_top_sort(ngx_http_accounting_top_t *top);
+
+#endif /* _NGX_HTTP_ACCOUNTING_TOP_H_INCLUDED_ */
@@ -11,35 +11,135 @@
 #include "ngx_http_accounting_status_code.h"
 #include "ngx_http_accounting_worker_process.h"
 #include "ngx_http_accounting_prefix.h"
+#include "ngx_http_accounting_quota.h"
+#include "ngx_http_accounting_slo.h"
+#include "ngx_http_accounting_history.h"
+#include "ngx_http_accounting_snapshot.h"
+#include "ngx_http_accounting_snapshot_format.h"
+#include "ngx_http_accounting_hll.h"
+#include "ngx_http_accounting_cpu.h"
+#include "ngx_http_accounting_record.h"
 
 
 static ngx_event_t  write_out_ev;
+static ngx_http_accounting_main_conf_t  *worker_process_amcf;
 static ngx_http_accounting_hash_t  stats_hash;
+static ngx_array_t  worker_process_entries;
+static ngx_str_t  worker_process_snapshot_path;
+static ngx_http_accounting_history_t  *worker_process_history;
+static ngx_flag_t   worker_process_export;
+static ngx_flag_t   worker_process_file;
+
+// requests registered for progressive accounting that are still running
+static ngx_flag_t   worker_process_progressive;
+static ngx_flag_t   worker_process_concurrency;
+static ngx_queue_t  worker_process_progress;
+
+// CPU attribution: clock and ns per clock unit
+static ngx_uint_t   worker_process_cpu_mode;
+static double       worker_process_cpu_scale = 1.0;
+static uint64_t     worker_process_cpu_tsc;
+static uint64_t     worker_process_cpu_monotonic;
+
+// syslog line, grown as long lines need it
+#define NGX_HTTP_ACCOUNTING_LINE_MAX  65536
+
+static char         worker_process_line_buffer[2048];
+static char        *worker_process_line = worker_process_line_buffer;
+static size_t       worker_process_line_size = sizeof(worker_process_line_buffer);
 
 static ngx_int_t ngx_http_accounting_old_time = 0;
 static ngx_int_t ngx_http_accounting_new_time = 0;
 
+// slowest and largest requests kept per id and interval, 0 is off
+static ngx_uint_t worker_process_top;
+
 static ngx_uint_t worker_process_interval = 10;
+static ngx_uint_t worker_process_depth = 1;
+
+// adaptive sampling: requests per second above which the sampled dimensions are
+// only updated for every 2^shift-th request, 0 disables sampling
+static ngx_uint_t worker_process_sampling = 0;
+static ngx_uint_t worker_process_sample_shift = 0;
+static ngx_uint_t worker_process_sample_count = 0;
+static time_t     worker_process_sample_second = 0;
+
+// per level: cardinality cap (0 is unlimited), number of entries and list of entries
+static ngx_uint_t worker_process_level_caps[NGX_HTTP_ACCOUNTING_MAX_DEPTH];
+static ngx_uint_t worker_process_level_count[NGX_HTTP_ACCOUNTING_MAX_DEPTH];
+static ngx_http_accounting_stats_t *worker_process_levels[NGX_HTTP_ACCOUNTING_MAX_DEPTH];
+
+// "~other" of the top level, every id below has its own "<parent>/~other"
+static ngx_http_accounting_stats_t *worker_process_other;
+
+// ids known ahead, their entries are allocated on first use, by slot
+static ngx_http_accounting_registry_t  *worker_process_registry;
+static ngx_http_accounting_stats_t    **worker_process_registry_stats;
+
+typedef void (*worker_process_format_pt)(ngx_http_accounting_record_t *rec,
+    ngx_http_accounting_stats_t *stats, void *data);
+
+typedef struct {
+    const char                       *kind;
+    ngx_uint_t                        rank;
+    ngx_http_accounting_top_entry_t  *entry;
+} worker_process_top_line_t;
 
 static u_char *ngx_http_accounting_title = (u_char *)"NgxAccounting";
 
 static void worker_process_alarm_handler(ngx_event_t *ev);
+static ngx_uint_t worker_process_sample(void);
+static void worker_process_account_sampled(ngx_http_request_t *r,
+    ngx_http_accounting_stats_t *stats);
 static ngx_str_t create_accounting_id(u_char *key, int len);
+static ngx_int_t worker_process_find_stats(ngx_http_request_t *r,
+    ngx_http_accounting_stats_t **stats);
+static ngx_int_t worker_process_find_id_stats(ngx_pool_t *pool, ngx_str_t *id,
+    ngx_http_accounting_stats_t **stats);
+static void worker_process_account(ngx_http_accounting_stats_t *stats,
+    ngx_http_accounting_session_t *session);
+static ngx_http_accounting_ctx_t *worker_process_get_ctx(ngx_http_request_t *r);
+static void worker_process_ctx_cleanup(void *data);
+static void worker_process_progress_flush(void);
+static ngx_http_accounting_top_t *worker_process_get_top(ngx_http_accounting_stats_t *stats);
+static void worker_process_account_top(ngx_http_request_t *r, ngx_http_accounting_stats_t *stats,
+    ngx_http_accounting_session_t *session);
+static void worker_process_cpu_calibrate(void);
+static ngx_int_t worker_process_init_registry(ngx_cycle_t *cycle,
+    ngx_http_accounting_main_conf_t *amcf);
+static ngx_http_accounting_stats_t *worker_process_registry_get(ngx_uint_t slot);
+static ngx_http_accounting_stats_t *worker_process_registry_find_other(ngx_pool_t *pool,
+    ngx_str_t *id);
+static ngx_http_accounting_stats_t *worker_process_lookup(ngx_uint_t key, ngx_str_t *name);
+static ngx_http_accounting_stats_t *worker_process_find_id(ngx_http_accounting_main_conf_t *amcf,
+    ngx_str_t *name, ngx_uint_t level);
+static ngx_http_accounting_stats_t *worker_process_find_path(ngx_pool_t *pool, ngx_str_t *path);
+static ngx_http_accounting_stats_t *worker_process_find_other(ngx_pool_t *pool,
+    ngx_http_accounting_stats_t *parent, ngx_uint_t level);
+static ngx_http_accounting_stats_t *worker_process_add_stats(ngx_http_accounting_main_conf_t *amcf,
+    ngx_uint_t key, ngx_str_t *name, ngx_uint_t level, ngx_http_accounting_stats_t *parent);
+static ngx_http_accounting_stats_t *worker_process_new_stats(ngx_http_accounting_main_conf_t *amcf,
+    ngx_uint_t key, ngx_str_t *name, ngx_uint_t level, ngx_http_accounting_stats_t *parent);
 
 
 ngx_int_t
 ngx_http_accounting_worker_process_init(ngx_cycle_t *cycle)
 {
     ngx_int_t rc;
+    ngx_int_t   *caps;
+    ngx_uint_t   i;
     ngx_time_t  *time;
     ngx_http_accounting_main_conf_t *amcf;
 
     amcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_accounting_module);
 
-    if (!amcf->enable) {
+    // no http block at all, stream sessions have nowhere to go either
+    if (amcf == NULL || !amcf->enable) {
         return NGX_OK;
     }
 
+    worker_process_amcf = amcf;
+
     init_http_status_code_map();
 
     time = ngx_timeofday();
@@ -54,6 +154,46 @@ ngx_http_accounting_worker_process_init(ngx_cycle_t *cycle)
         return rc;
     }
 
+    if (ngx_array_init(&worker_process_entries, cycle->pool, 64,
+                       sizeof(ngx_http_accounting_stats_t *))
+        != NGX_OK)
+    {
+        return NGX_ERROR;
+    }
+
+    worker_process_snapshot_path = amcf->snapshot_path;
+    worker_process_history = amcf->history;
+
+    if (amcf->exporter != NULL) {
+        if (ngx_http_accounting_exporter_init(cycle, amcf->exporter) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        worker_process_export = 1;
+    }
+
+    if (amcf->file != NULL) {
+        if (ngx_http_accounting_file_init(cycle, amcf->file) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        worker_process_file = 1;
+    }
+
+    worker_process_progressive = amcf->progressive;
+    worker_process_concurrency = amcf->concurrency;
+    ngx_queue_init(&worker_process_progress);
+
+    worker_process_cpu_mode = amcf->cpu;
+    if (worker_process_cpu_mode == NGX_HTTP_ACCOUNTING_CPU_TSC) {
+        worker_process_cpu_calibrate();
+    }
+
+    if (amcf->distincts != NULL) {
+        ngx_http_accounting_distincts = amcf->distincts->elts;
+        ngx_http_accounting_nr_distincts = amcf->distincts->nelts;
+    }
+
     ngx_memzero(&write_out_ev, sizeof(ngx_event_t));
 
     write_out_ev.data = NULL;
@@ -61,6 +201,20 @@ ngx_http_accounting_worker_process_init(ngx_cycle_t *cycle)
     write_out_ev.handler = worker_process_alarm_handler;
 
     worker_process_interval = amcf->interval;
+    worker_process_depth = amcf->depth;
+    worker_process_sampling = amcf->sampling;
+    worker_process_top = amcf->top;
+
+    if (amcf->depth_caps != NULL) {
+        caps = amcf->depth_caps->elts;
+        for (i = 0; i < amcf->depth_caps->nelts; i++) {
+            worker_process_level_caps[i] = caps[i];
+        }
+    }
+
+    if (amcf->registry != NULL && worker_process_init_registry(cycle, amcf) != NGX_OK) {
+        return NGX_ERROR;
+    }
     
     srand(ngx_getpid());
     ngx_add_timer(&write_out_ev, worker_process_interval*(1000-rand()%200));
@@ -75,7 +229,7 @@ void ngx_http_accounting_worker_process_exit(ngx_cycle_t *cycle)
 
     amcf = ngx_http_cycle_get_module_main_conf(cycle, ngx_http_accounting_module);
 
-    if (!amcf->enable) {
+    if (amcf == NULL || !amcf->enable) {
         return;
     }
 
@@ -85,136 +239,953 @@ void ngx_http_accounting_worker_process_exit(ngx_cycle_t *cycle)
 ngx_int_t
 ngx_http_accounting_handler(ngx_http_request_t *r)
 {
-    ngx_str_t       prefix;
-    ngx_uint_t      key;
-
-    ngx_uint_t      status;
-    ngx_uint_t     *status_array;
-
-
-    ngx_http_accounting_stats_t *stats;
+    ngx_int_t       rc;
+    ngx_uint_t      sampled;
+    ngx_http_accounting_stats_t    *stats;
+    ngx_http_accounting_ctx_t      *ctx;
+    ngx_http_accounting_session_t   session;
 
     ngx_time_t * time = ngx_timeofday();
 
-    prefix = extract_routing_prefix(r);
+    ngx_memzero(&session, sizeof(ngx_http_accounting_session_t));
 
-    ngx_uint_t req_latency_ms = (time->sec * 1000 + time->msec) - (r->start_sec * 1000 + r->start_msec);
+    session.latency_ms = (time->sec * 1000 + time->msec) - (r->start_sec * 1000 + r->start_msec);
 
-    // following magic airlifted from ngx_http_upstream.c:4416-4423
-    ngx_uint_t upstream_req_latency_ms = 0;
+    // walk every upstream attempt, entries without a peer separate upstream groups
+    // (e.g. after an internal redirect), see ngx_http_upstream_status_variable()
+    ngx_uint_t  i;
+    ngx_uint_t  upstream_groups = 0;
     ngx_http_upstream_state_t  *state;
 
     if (r->upstream_states != NULL && r->upstream_states->nelts != 0) {
         state = r->upstream_states->elts;
-        if (state[0].status) {
-            // not even checking the status here...
-	    upstream_req_latency_ms = (state[0].response_time);
+        upstream_groups = 1;
+
+        for (i = 0; i < r->upstream_states->nelts; i++) {
+            if (state[i].peer == NULL) {
+                if (i != 0) {
+                    upstream_groups++;
+                }
+                continue;
+            }
+
+            session.upstream_attempts++;
+
+            if (state[i].response_time != (ngx_msec_t) -1) {
+                session.upstream_latency_ms += state[i].response_time;
+            }
+            if (state[i].connect_time != (ngx_msec_t) -1) {
+                session.upstream_connect_ms += state[i].connect_time;
+            }
+            if (state[i].header_time != (ngx_msec_t) -1) {
+                session.upstream_header_ms += state[i].header_time;
+            }
+
+            // no response at all, or the upstream answered with a server error
+            if (state[i].status == 0 || state[i].status >= NGX_HTTP_INTERNAL_SERVER_ERROR) {
+                session.upstream_errors++;
+            }
         }
     }
-    // TODO: key should be cached to save CPU time
-    key = ngx_hash_key_lc(prefix.data, prefix.len);
-    stats = ngx_http_accounting_hash_find(&stats_hash, key, prefix.data, prefix.len);
 
-    if (stats == NULL) {
-        // new routing prefix, so let's create a new accounting_id
-        ngx_str_t accounting_id = create_accounting_id(prefix.data, prefix.len);
-        stats = ngx_pcalloc(stats_hash.pool, sizeof(ngx_http_accounting_stats_t));
-        status_array = ngx_pcalloc(stats_hash.pool, sizeof(ngx_uint_t) * http_status_code_count);
+    if (session.upstream_attempts > upstream_groups) {
+        session.upstream_retries = session.upstream_attempts - upstream_groups;
+    }
 
-        if (stats == NULL || status_array == NULL)
-            return NGX_ERROR;
+    rc = worker_process_find_stats(r, &stats);
+    if (rc != NGX_OK) {
+        return rc == NGX_DECLINED ? NGX_OK : rc;
+    }
+
+    // bytes of in-flight requests are charged at every flush, only the rest is left
+    session.size_in = r->request_length;
+    session.size_out = r->connection->sent;
+    session.bytes_in = session.size_in;
+    session.bytes_out = session.size_out;
 
-        stats->http_status_code = status_array;
-        ngx_http_accounting_hash_add(&stats_hash, key, accounting_id.data, accounting_id.len, stats);
+    ctx = worker_process_get_ctx(r);
+    if (ctx != NULL) {
+        session.bytes_in -= ctx->bytes_in;
+        session.bytes_out -= ctx->bytes_out;
+        ctx->bytes_in = r->request_length;
+        ctx->bytes_out = r->connection->sent;
+
+        // after an internal redirect to another id, the bytes stay with the id
+        // the flushes charged them to, the rest of the request goes to the new one
+        if (worker_process_progressive && ctx->stats != stats) {
+            ctx->stats->bytes_in += session.bytes_in;
+            ctx->stats->bytes_out += session.bytes_out;
+            session.bytes_in = 0;
+            session.bytes_out = 0;
+        }
+
+        // the request was counted against the quota of the id it had in preaccess,
+        // a rejected one is not charged at all
+        session.reserved = ctx->quota && ctx->stats->quota == stats->quota;
+        session.rejected = ctx->rejected;
     }
 
+    // requests with a context were sampled or not as they entered preaccess
+    sampled = ctx ? ctx->sampled : worker_process_sample();
+
     if (r->err_status) {
-        status = r->err_status;
+        session.status = r->err_status;
     } else if (r->headers_out.status) {
-        status = r->headers_out.status;
+        session.status = r->headers_out.status;
     } else {
-        status = NGX_HTTP_DEFAULT;
+        session.status = NGX_HTTP_DEFAULT;
+    }
+
+    worker_process_account(stats, &session);
+
+    // the counters stay exact, the expensive dimensions are sampled under load
+    if (sampled) {
+        worker_process_account_sampled(r, stats);
+
+        if (worker_process_top) {
+            worker_process_account_top(r, stats, &session);
+        }
+
+        if (ctx && worker_process_cpu_mode != NGX_HTTP_ACCOUNTING_CPU_OFF) {
+            stats->cpu_ns += ngx_http_accounting_cpu_elapsed(ctx->cpu_start,
+                                                             worker_process_cpu_mode,
+                                                             worker_process_cpu_scale);
+        }
+    }
+
+    return NGX_OK;
+}
+
+
+/*
+ * Sessions of other modules (the stream one) go into the same table and the
+ * same lines, they have no sampled dimensions.
+ */
+ngx_int_t
+ngx_http_accounting_account_session(ngx_pool_t *pool, ngx_str_t *id,
+    ngx_http_accounting_session_t *session)
+{
+    ngx_int_t                     rc;
+    ngx_uint_t                    depth;
+    ngx_str_t                     path;
+    ngx_http_accounting_stats_t  *stats;
+
+    if (worker_process_amcf == NULL) {
+        return NGX_DECLINED;
+    }
+
+    // as deep as request paths go
+    path = *id;
+
+    for (depth = 0, path.len = 0; path.len < id->len; path.len++) {
+        if (id->data[path.len] == '/' && ++depth == worker_process_depth) {
+            break;
+        }
     }
 
+    rc = worker_process_find_id_stats(pool, &path, &stats);
+    if (rc != NGX_OK) {
+        return rc;
+    }
+
+    worker_process_account(stats, session);
+
+    stats->nr_sampled += 1;
+
+    return NGX_OK;
+}
+
+
+static void
+worker_process_account(ngx_http_accounting_stats_t *stats, ngx_http_accounting_session_t *session)
+{
+    ngx_uint_t  i, status;
+
+    status = session->status < 512 ? session->status : NGX_HTTP_DEFAULT;
+
     stats->nr_requests += 1;
-    stats->bytes_in += r->request_length;
-    stats->bytes_out += r->connection->sent;
-    stats->total_latency_ms += req_latency_ms;
-    stats->upstream_total_latency_ms += upstream_req_latency_ms;
+    stats->bytes_in += session->bytes_in;
+    stats->bytes_out += session->bytes_out;
+    stats->total_latency_ms += session->latency_ms;
+    stats->upstream_total_latency_ms += session->upstream_latency_ms;
+    stats->upstream_connect_ms += session->upstream_connect_ms;
+    stats->upstream_header_ms += session->upstream_header_ms;
+    stats->upstream_attempts += session->upstream_attempts;
+    stats->upstream_retries += session->upstream_retries;
+    stats->upstream_errors += session->upstream_errors;
     stats->http_status_code[http_status_code_to_index_map[status]] += 1;
+    stats->size_in[ngx_http_accounting_size_bucket(session->size_in)] += 1;
+    stats->size_out[ngx_http_accounting_size_bucket(session->size_out)] += 1;
 
-    return NGX_OK;
+    if (stats->quota && !session->rejected) {
+        ngx_http_accounting_quota_charge(stats->quota, !session->reserved,
+                                         session->size_in + session->size_out);
+    }
+
+    // against every SLO latency, the flush hands the count of the subtree to each SLO
+    for (i = 0; i < worker_process_amcf->nr_slo_latencies; i++) {
+        if (session->latency_ms > worker_process_amcf->slo_latencies[i]) {
+            stats->slow[i] += 1;
+        }
+    }
+}
+
+
+static ngx_http_accounting_top_t *
+worker_process_get_top(ngx_http_accounting_stats_t *stats)
+{
+    ngx_http_accounting_top_entry_t  *entries;
+
+    if (stats->top) {
+        return stats->top;
+    }
+
+    stats->top = ngx_pcalloc(stats_hash.pool, 2 * sizeof(ngx_http_accounting_top_t));
+    entries = ngx_palloc(stats_hash.pool,
+                         2 * worker_process_top * sizeof(ngx_http_accounting_top_entry_t));
+
+    if (stats->top == NULL || entries == NULL) {
+        stats->top = NULL;
+        return NULL;
+    }
+
+    stats->top[NGX_HTTP_ACCOUNTING_TOP_SLOW].k = worker_process_top;
+    stats->top[NGX_HTTP_ACCOUNTING_TOP_SLOW].entries = entries;
+    stats->top[NGX_HTTP_ACCOUNTING_TOP_LARGE].k = worker_process_top;
+    stats->top[NGX_HTTP_ACCOUNTING_TOP_LARGE].entries = entries + worker_process_top;
+
+    return stats->top;
+}
+
+
+// most requests make neither list and cost two compares
+static void
+worker_process_account_top(ngx_http_request_t *r, ngx_http_accounting_stats_t *stats,
+    ngx_http_accounting_session_t *session)
+{
+    ngx_uint_t                        slow, large;
+    ngx_str_t                         uri;
+    ngx_http_accounting_top_t        *top;
+    ngx_http_accounting_top_entry_t   entry;
+
+    top = worker_process_get_top(stats);
+    if (top == NULL) {
+        return;
+    }
+
+    entry.latency_ms = session->latency_ms;
+    entry.bytes = session->size_in + session->size_out;
+
+    slow = ngx_http_accounting_top_admits(&top[NGX_HTTP_ACCOUNTING_TOP_SLOW], entry.latency_ms);
+    large = ngx_http_accounting_top_admits(&top[NGX_HTTP_ACCOUNTING_TOP_LARGE], entry.bytes);
+
+    if (!slow && !large) {
+        return;
+    }
+
+    // the URI as the client sent it, without the arguments
+    uri = r->unparsed_uri.len ? r->unparsed_uri : r->uri;
+
+    if (r->args_start && r->args_start > uri.data && r->args_start <= uri.data + uri.len) {
+        uri.len = r->args_start - 1 - uri.data;
+    }
+
+    entry.upstream_ms = session->upstream_latency_ms;
+    entry.status = (uint16_t) session->status;
+    entry.uri_len = (uint16_t) ngx_min(uri.len, NGX_HTTP_ACCOUNTING_TOP_URI_LEN);
+    ngx_memcpy(entry.uri, uri.data, entry.uri_len);
+
+    if (slow) {
+        entry.key = entry.latency_ms;
+        ngx_http_accounting_top_add(&top[NGX_HTTP_ACCOUNTING_TOP_SLOW], &entry);
+    }
+
+    if (large) {
+        entry.key = entry.bytes;
+        ngx_http_accounting_top_add(&top[NGX_HTTP_ACCOUNTING_TOP_LARGE], &entry);
+    }
 }
 
 
 static ngx_int_t
-worker_process_write_out_stats(u_char *name, size_t len, void *val, void *para1, void *para2)
+worker_process_find_stats(ngx_http_request_t *r, ngx_http_accounting_stats_t **stats)
 {
-    ngx_uint_t   i;
+    ngx_str_t    prefix;
+
+    prefix = extract_routing_path(r, worker_process_depth);
+
+    return worker_process_find_id_stats(r->pool, &prefix, stats);
+}
+
+
+static ngx_int_t
+worker_process_find_id_stats(ngx_pool_t *pool, ngx_str_t *id, ngx_http_accounting_stats_t **stats)
+{
+    ngx_int_t    slot;
+    ngx_uint_t   key;
+
+    *stats = NULL;
+
+    if (worker_process_registry != NULL) {
+        slot = ngx_http_accounting_registry_find(worker_process_registry, id->data, id->len);
+
+        if (slot != NGX_ERROR) {
+            *stats = worker_process_registry_get(slot);
+            if (*stats == NULL)
+                return NGX_ERROR;
+
+        } else if (worker_process_registry->overflow == NGX_HTTP_ACCOUNTING_OVERFLOW_OTHER) {
+            *stats = worker_process_registry_find_other(pool, id);
+            if (*stats == NULL)
+                return NGX_ERROR;
+
+        } else if (worker_process_registry->overflow == NGX_HTTP_ACCOUNTING_OVERFLOW_DROP) {
+            return NGX_DECLINED;
+        }
+    }
+
+    if (*stats == NULL) {
+        // TODO: key should be cached to save CPU time
+        key = ngx_hash_key_lc(id->data, id->len);
+        *stats = ngx_http_accounting_hash_find(&stats_hash, key, id->data, id->len);
+    }
+
+    if (*stats == NULL) {
+        // new routing path, so let's create the accounting_ids it is made of
+        *stats = worker_process_find_path(pool, id);
+        if (*stats == NULL)
+            return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+
+/*
+ * Requests get a context once their location is known, it lives until their
+ * pool is destroyed. With a quota on its id the request is counted against
+ * it in the access phase, through the entry of the context. For progressive
+ * accounting it is on a list that every flush walks to charge the bytes
+ * transferred since the previous one to that entry, for the concurrency
+ * gauges it is counted in by its id. The sampling decision is taken here, so
+ * that the clock of CPU attribution is read only for sampled requests.
+ */
+ngx_int_t
+ngx_http_accounting_ctx_handler(ngx_http_request_t *r)
+{
+    ngx_pool_cleanup_t           *cln;
+    ngx_http_accounting_ctx_t    *ctx;
     ngx_http_accounting_stats_t  *stats;
 
-    char output_buffer[1024];
+    if (r->main != r || worker_process_get_ctx(r) != NULL) {
+        return NGX_DECLINED;
+    }
 
-    ngx_uint_t status_code_buckets[10];
-    ngx_memzero(status_code_buckets, sizeof(status_code_buckets));
+    if (worker_process_find_stats(r, &stats) != NGX_OK) {
+        return NGX_DECLINED;
+    }
+
+    cln = ngx_pool_cleanup_add(r->pool, sizeof(ngx_http_accounting_ctx_t));
+    if (cln == NULL) {
+        return NGX_HTTP_INTERNAL_SERVER_ERROR;
+    }
+
+    ctx = cln->data;
+    ctx->request = r;
+    ctx->stats = stats;
+    ctx->bytes_in = 0;
+    ctx->bytes_out = 0;
+    ctx->quota = 0;
+    ctx->rejected = 0;
+    ctx->sampled = worker_process_sample();
+
+    if (ctx->sampled && worker_process_cpu_mode != NGX_HTTP_ACCOUNTING_CPU_OFF) {
+        ctx->cpu_start = ngx_http_accounting_cpu_clock(worker_process_cpu_mode);
+    }
+
+    if (worker_process_progressive) {
+        ngx_queue_insert_tail(&worker_process_progress, &ctx->queue);
+    }
+
+    // the ids above get the gauge at the flush
+    if (worker_process_concurrency && ++stats->running > stats->max_running) {
+        stats->max_running = stats->running;
+    }
+
+    cln->handler = worker_process_ctx_cleanup;
+
+    ngx_http_set_ctx(r, ctx, ngx_http_accounting_module);
+
+    return NGX_DECLINED;
+}
 
-    stats = (ngx_http_accounting_stats_t *)val;
 
-    if (stats->nr_requests > 0) {
-        for (i = 0; i < http_status_code_count; i++) {
-            if (index_to_http_status_code_map[i] == NGX_HTTP_CLIENT_CLOSED_REQUEST) {
-                status_code_buckets[9] += stats->http_status_code[i];
-            } else {
-                ngx_uint_t bucket_idx = index_to_http_status_code_map[i] / 100;
-                status_code_buckets[bucket_idx] += stats->http_status_code[i];    
+/*
+ * Runs last in the access phase, so that only requests the access and auth
+ * modules let through count against the quota of their id, once even if an
+ * internal redirect takes them through the phase again.
+ */
+ngx_int_t
+ngx_http_accounting_quota_handler(ngx_http_request_t *r)
+{
+    ngx_http_accounting_ctx_t    *ctx;
+    ngx_http_accounting_quota_t  *quota;
+
+    ctx = worker_process_get_ctx(r);
+
+    if (ctx == NULL || ctx->quota || ctx->stats->quota == NULL) {
+        return NGX_DECLINED;
+    }
+
+    quota = ctx->stats->quota;
+    ctx->quota = 1;
+
+    if (ngx_http_accounting_quota_reserve(quota) != NGX_OK) {
+        ngx_log_error(NGX_LOG_INFO, r->connection->log, 0,
+                      "accounting quota exhausted for \"%V\"", &quota->id);
+        ctx->rejected = 1;
+        return quota->status;
+    }
+
+    return NGX_DECLINED;
+}
+
+
+// the module ctx is lost on internal redirects, the cleanup is not (see the realip module)
+static ngx_http_accounting_ctx_t *
+worker_process_get_ctx(ngx_http_request_t *r)
+{
+    ngx_pool_cleanup_t         *cln;
+    ngx_http_accounting_ctx_t  *ctx;
+
+    ctx = ngx_http_get_module_ctx(r, ngx_http_accounting_module);
+
+    if (ctx == NULL && (r->internal || r->filter_finalize)) {
+        for (cln = r->pool->cleanup; cln; cln = cln->next) {
+            if (cln->handler == worker_process_ctx_cleanup) {
+                ctx = cln->data;
+                ngx_http_set_ctx(r, ctx, ngx_http_accounting_module);
+                break;
             }
-            stats->http_status_code[i] = 0;
         }
+    }
+
+    return ctx;
+}
+
+
+static void
+worker_process_ctx_cleanup(void *data)
+{
+    ngx_http_accounting_ctx_t  *ctx = data;
+
+    if (worker_process_progressive) {
+        ngx_queue_remove(&ctx->queue);
+    }
+
+    if (worker_process_concurrency) {
+        ctx->stats->running--;
+    }
+}
+
+
+/*
+ * The time stamp counter ticks at a constant rate on current CPUs, which is
+ * measured against CLOCK_MONOTONIC: over a millisecond at startup, then from
+ * startup to every flush.
+ */
+static void
+worker_process_cpu_calibrate(void)
+{
+    uint64_t  tsc, monotonic;
+
+    if (worker_process_cpu_tsc == 0) {
+        worker_process_cpu_tsc = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_TSC);
+        worker_process_cpu_monotonic = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+
+        do {
+            monotonic = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+        } while (monotonic - worker_process_cpu_monotonic < 1000000);
+
     } else {
-        // no requests, let's not emit any stats!
+        monotonic = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+    }
+
+    tsc = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_TSC);
+
+    if (tsc > worker_process_cpu_tsc) {
+        worker_process_cpu_scale = (double) (monotonic - worker_process_cpu_monotonic)
+                                   / (tsc - worker_process_cpu_tsc);
+    }
+}
+
+
+// charges what in-flight requests transferred since the previous flush
+static void
+worker_process_progress_flush(void)
+{
+    off_t                       sent;
+    ngx_queue_t                *q;
+    ngx_http_request_t         *r;
+    ngx_http_accounting_ctx_t  *ctx;
+
+    for (q = ngx_queue_head(&worker_process_progress);
+         q != ngx_queue_sentinel(&worker_process_progress);
+         q = ngx_queue_next(q))
+    {
+        ctx = ngx_queue_data(q, ngx_http_accounting_ctx_t, queue);
+        r = ctx->request;
+        sent = r->connection->sent;
+
+        ctx->stats->bytes_in += r->request_length - ctx->bytes_in;
+        ctx->stats->bytes_out += sent - ctx->bytes_out;
+
+        ctx->bytes_in = r->request_length;
+        ctx->bytes_out = sent;
+    }
+}
+
+
+static ngx_uint_t
+worker_process_sample(void)
+{
+    time_t  now;
+
+    if (worker_process_sampling == 0) {
+        return 1;
+    }
+
+    // once a second, pick the smallest power of two rate that keeps the
+    // number of sampled requests of the last second within the budget
+    now = ngx_time();
+
+    if (now != worker_process_sample_second) {
+        if (now == worker_process_sample_second + 1) {
+            while (worker_process_sample_shift < NGX_HTTP_ACCOUNTING_MAX_SAMPLE_SHIFT
+                   && (worker_process_sample_count >> worker_process_sample_shift)
+                      > worker_process_sampling)
+            {
+                worker_process_sample_shift++;
+            }
+
+            while (worker_process_sample_shift > 0
+                   && (worker_process_sample_count >> (worker_process_sample_shift - 1))
+                      <= worker_process_sampling)
+            {
+                worker_process_sample_shift--;
+            }
+
+        } else {
+            // idle for more than a second
+            worker_process_sample_shift = 0;
+        }
+
+        worker_process_sample_second = now;
+        worker_process_sample_count = 0;
+    }
+
+    return (worker_process_sample_count++ & ((1 << worker_process_sample_shift) - 1)) == 0;
+}
+
+
+static void
+worker_process_account_sampled(ngx_http_request_t *r, ngx_http_accounting_stats_t *stats)
+{
+    ngx_uint_t                  i;
+    ngx_http_variable_value_t  *distinct;
+
+    stats->nr_sampled += 1;
+
+    for (i = 0; i < ngx_http_accounting_nr_distincts; i++) {
+        distinct = ngx_http_get_indexed_variable(r, ngx_http_accounting_distincts[i].index);
+
+        if (distinct == NULL || distinct->not_found || distinct->len == 0) {
+            continue;
+        }
+
+        ngx_http_accounting_hll_add(stats->distinct[i], ngx_http_accounting_distincts[i].precision,
+                                    ngx_http_accounting_hll_hash(distinct->data, distinct->len));
+    }
+}
+
+
+static ngx_int_t
+worker_process_collect_stats(u_char *name, size_t len, void *val, void *para1, void *para2)
+{
+    ngx_array_t                   *entries = para1;
+    ngx_http_accounting_stats_t   *stats = val;
+    ngx_http_accounting_stats_t  **entry;
+
+    // no requests nor running ones, let's not emit any stats!
+    if (stats->nr_requests == 0 && stats->bytes_in == 0 && stats->bytes_out == 0
+        && stats->max_in_flight == 0 && stats->cpu_ns == 0)
+    {
         return NGX_OK;
     }
 
-    sprintf(output_buffer, "%i|%ld|%ld|%s|%ld|%ld|%ld|%lu|%lu|%lu|%lu|%lu|%lu",
-                ngx_getpid(),
-                ngx_http_accounting_old_time,
-                ngx_http_accounting_new_time,
-                name,
-                stats->nr_requests,
-                stats->bytes_in,
-                stats->bytes_out,
-                stats->total_latency_ms / (stats->nr_requests > 0 ? stats->nr_requests : 1),
-                stats->upstream_total_latency_ms / (stats->nr_requests > 0 ? stats->nr_requests : 1),
-                status_code_buckets[2],
-                status_code_buckets[4],
-                status_code_buckets[5],
-                status_code_buckets[9]
-            );
-
-    stats->nr_requests = 0;
-    stats->bytes_out = 0;
-    stats->bytes_in = 0;
-    stats->total_latency_ms = 0;
-    stats->upstream_total_latency_ms = 0;
-
-    syslog(LOG_INFO, "%s", output_buffer);
+    entry = ngx_array_push(entries);
+    if (entry == NULL) {
+        return NGX_ERROR;
+    }
+
+    *entry = val;
 
     return NGX_OK;
 }
 
 
+static int ngx_libc_cdecl
+worker_process_cmp_stats(const void *one, const void *two)
+{
+    ngx_http_accounting_stats_t  *a = *(ngx_http_accounting_stats_t **) one;
+    ngx_http_accounting_stats_t  *b = *(ngx_http_accounting_stats_t **) two;
+
+    return ngx_http_accounting_snapshot_name_cmp((char *) a->name.data, a->name.len,
+                                                 (char *) b->name.data, b->name.len);
+}
+
+
+// bucket:count pairs, empty buckets are left out
+static void
+worker_process_format_sizes(ngx_http_accounting_record_t *rec, const char *name,
+    ngx_uint_t *buckets)
+{
+    ngx_uint_t  i;
+
+    ngx_http_accounting_record_list(rec, name);
+
+    for (i = 0; i < NGX_HTTP_ACCOUNTING_SIZE_BUCKETS; i++) {
+        if (buckets[i] != 0) {
+            ngx_http_accounting_record_pair(rec, i, buckets[i]);
+        }
+    }
+
+    ngx_http_accounting_record_list_end(rec);
+}
+
+
+static void
+worker_process_format_burn(ngx_http_accounting_record_t *rec, ngx_http_accounting_slo_t *slo)
+{
+    double      availability, latency;
+    ngx_uint_t  i;
+
+    static struct {
+        const char  *availability;
+        const char  *latency;
+        ngx_uint_t   minutes;
+    } windows[] = {
+        { "burn_availability_5m", "burn_latency_5m", 5 },
+        { "burn_availability_1h", "burn_latency_1h", 60 },
+        { "burn_availability_6h", "burn_latency_6h", 360 },
+    };
+
+    for (i = 0; i < sizeof(windows) / sizeof(windows[0]); i++) {
+        ngx_http_accounting_slo_burn(slo, ngx_time(), windows[i].minutes, &availability, &latency);
+
+        if (slo->availability) {
+            ngx_http_accounting_record_fixed(rec, windows[i].availability, availability, 2);
+        }
+
+        if (slo->latency) {
+            ngx_http_accounting_record_fixed(rec, windows[i].latency, latency, 2);
+        }
+    }
+}
+
+
+static void
+worker_process_format_stats(ngx_http_accounting_record_t *rec, ngx_http_accounting_stats_t *stats,
+    void *data)
+{
+    u_char      name[64], *p;
+    ngx_uint_t  i, requests, attempts;
+    ngx_uint_t  status_code_buckets[10];
+
+    ngx_http_accounting_stats_status_classes(stats, status_code_buckets);
+
+    requests = stats->nr_requests > 0 ? stats->nr_requests : 1;
+    attempts = stats->upstream_attempts > 0 ? stats->upstream_attempts : 1;
+
+    ngx_http_accounting_record_uint(rec, "pid", ngx_getpid());
+    ngx_http_accounting_record_uint(rec, "from", ngx_http_accounting_old_time);
+    ngx_http_accounting_record_uint(rec, "to", ngx_http_accounting_new_time);
+    ngx_http_accounting_record_string(rec, "id", (char *) stats->name.data, stats->name.len);
+    ngx_http_accounting_record_uint(rec, "requests", stats->nr_requests);
+    ngx_http_accounting_record_uint(rec, "bytes_in", stats->bytes_in);
+    ngx_http_accounting_record_uint(rec, "bytes_out", stats->bytes_out);
+    ngx_http_accounting_record_uint(rec, "latency_ms", stats->total_latency_ms / requests);
+    ngx_http_accounting_record_uint(rec, "upstream_latency_ms",
+                                    stats->upstream_total_latency_ms / requests);
+    ngx_http_accounting_record_uint(rec, "2xx", status_code_buckets[2]);
+    ngx_http_accounting_record_uint(rec, "4xx", status_code_buckets[4]);
+    ngx_http_accounting_record_uint(rec, "5xx", status_code_buckets[5]);
+    ngx_http_accounting_record_uint(rec, "499", status_code_buckets[9]);
+
+    // the positional fields stay those of the original line, everything later is named
+    ngx_http_accounting_record_extras(rec);
+
+    ngx_http_accounting_record_uint(rec, "upstream_attempts", stats->upstream_attempts);
+    ngx_http_accounting_record_uint(rec, "upstream_retries", stats->upstream_retries);
+    ngx_http_accounting_record_uint(rec, "upstream_errors", stats->upstream_errors);
+    ngx_http_accounting_record_uint(rec, "upstream_connect_ms", stats->upstream_connect_ms / attempts);
+    ngx_http_accounting_record_uint(rec, "upstream_header_ms", stats->upstream_header_ms / attempts);
+    ngx_http_accounting_record_uint(rec, "level", stats->level);
+
+    if (worker_process_sampling && stats->nr_requests) {
+        ngx_http_accounting_record_fixed(rec, "sample_rate",
+                                         (double) stats->nr_sampled / stats->nr_requests, 4);
+    }
+
+    for (i = 0; i < ngx_http_accounting_nr_distincts; i++) {
+        p = ngx_cpymem(name, "distinct_", sizeof("distinct_") - 1);
+        p = ngx_cpymem(p, ngx_http_accounting_distincts[i].name.data,
+                       ngx_min(ngx_http_accounting_distincts[i].name.len, sizeof(name) - 10));
+        *p = '\0';
+
+        ngx_http_accounting_record_uint(rec, (char *) name,
+                                        ngx_http_accounting_hll_estimate(stats->distinct[i],
+                                                   ngx_http_accounting_distincts[i].precision));
+    }
+
+    worker_process_format_sizes(rec, "size_in", stats->size_in);
+    worker_process_format_sizes(rec, "size_out", stats->size_out);
+
+    if (worker_process_concurrency) {
+        ngx_http_accounting_record_uint(rec, "in_flight", stats->in_flight);
+        ngx_http_accounting_record_uint(rec, "max_in_flight", stats->max_in_flight);
+    }
+
+    if (worker_process_cpu_mode != NGX_HTTP_ACCOUNTING_CPU_OFF) {
+        ngx_http_accounting_record_uint(rec, "cpu_ns", stats->cpu_ns);
+    }
+
+    if (stats->slo) {
+        worker_process_format_burn(rec, stats->slo);
+    }
+}
+
+
+// one line per kept request, with the kind instead of the request count
+static void
+worker_process_format_top(ngx_http_accounting_record_t *rec, ngx_http_accounting_stats_t *stats,
+    void *data)
+{
+    worker_process_top_line_t  *line = data;
+
+    ngx_http_accounting_record_uint(rec, "pid", ngx_getpid());
+    ngx_http_accounting_record_uint(rec, "from", ngx_http_accounting_old_time);
+    ngx_http_accounting_record_uint(rec, "to", ngx_http_accounting_new_time);
+    ngx_http_accounting_record_string(rec, "id", (char *) stats->name.data, stats->name.len);
+    ngx_http_accounting_record_string(rec, "top", line->kind, ngx_strlen(line->kind));
+    ngx_http_accounting_record_uint(rec, "rank", line->rank);
+    ngx_http_accounting_record_uint(rec, "status", line->entry->status);
+    ngx_http_accounting_record_uint(rec, "latency_ms", line->entry->latency_ms);
+    ngx_http_accounting_record_uint(rec, "upstream_latency_ms", line->entry->upstream_ms);
+    ngx_http_accounting_record_uint(rec, "bytes", line->entry->bytes);
+    ngx_http_accounting_record_string(rec, "uri", line->entry->uri, line->entry->uri_len);
+}
+
+
+/*
+ * Syslog lines are formatted into a buffer that doubles whenever a line did
+ * not fit, up to NGX_HTTP_ACCOUNTING_LINE_MAX; lines longer than that are
+ * cut and logged as such.
+ */
+static void
+worker_process_write_out(worker_process_format_pt format, ngx_http_accounting_stats_t *stats,
+    void *data)
+{
+    char                          *buf;
+    size_t                         size;
+    ngx_http_accounting_record_t   rec;
+
+    // into the file buffer, a record that did not fit is written again once it is flushed
+    if (worker_process_file) {
+        do {
+            format(ngx_http_accounting_file_record(), stats, data);
+        } while (ngx_http_accounting_file_commit(write_out_ev.log) == NGX_AGAIN);
+
+        return;
+    }
+
+    for ( ;; ) {
+        ngx_http_accounting_record_begin(&rec, worker_process_line, worker_process_line_size,
+                                         NGX_HTTP_ACCOUNTING_RECORD_SYSLOG);
+        format(&rec, stats, data);
+        (void) ngx_http_accounting_record_end(&rec);
+
+        if (!rec.full || worker_process_line_size >= NGX_HTTP_ACCOUNTING_LINE_MAX) {
+            break;
+        }
+
+        size = worker_process_line_size * 2;
+
+        buf = ngx_alloc(size, write_out_ev.log);
+        if (buf == NULL) {
+            break;
+        }
+
+        if (worker_process_line != worker_process_line_buffer) {
+            ngx_free(worker_process_line);
+        }
+
+        worker_process_line = buf;
+        worker_process_line_size = size;
+    }
+
+    if (rec.full) {
+        ngx_log_error(NGX_LOG_WARN, write_out_ev.log, 0,
+                      "accounting line of \"%V\" cut at %uz bytes", &stats->name,
+                      worker_process_line_size);
+    }
+
+    syslog(LOG_INFO, "%s", worker_process_line);
+}
+
+
+static void
+worker_process_write_out_stats(ngx_http_accounting_stats_t *stats)
+{
+    ngx_uint_t                  kind;
+    ngx_http_accounting_top_t  *top;
+    worker_process_top_line_t   line;
+
+    static const char  *kinds[] = { "slow", "large" };
+
+    worker_process_write_out(worker_process_format_stats, stats, NULL);
+
+    if (stats->top == NULL) {
+        return;
+    }
+
+    for (kind = NGX_HTTP_ACCOUNTING_TOP_SLOW; kind <= NGX_HTTP_ACCOUNTING_TOP_LARGE; kind++) {
+        top = &stats->top[kind];
+
+        ngx_http_accounting_top_sort(top);
+
+        line.kind = kinds[kind];
+
+        for (line.rank = 1; line.rank <= top->n; line.rank++) {
+            line.entry = &top->entries[line.rank - 1];
+            worker_process_write_out(worker_process_format_top, stats, &line);
+        }
+    }
+}
+
+
+// hands the subtree counts of an SLO id since the previous flush to its shared window
+static void
+worker_process_slo_add(ngx_http_accounting_stats_t *stats)
+{
+    ngx_uint_t                  slow;
+    ngx_uint_t                  status_code_buckets[10];
+    ngx_http_accounting_slo_t  *slo = stats->slo;
+
+    ngx_http_accounting_stats_status_classes(stats, status_code_buckets);
+
+    slow = slo->latency ? stats->slow[slo->latency_index] : 0;
+
+    ngx_http_accounting_slo_add(slo, ngx_http_accounting_new_time, stats->nr_requests,
+                                status_code_buckets[5], slow);
+}
+
+
 static void
 worker_process_alarm_handler(ngx_event_t *ev)
 {
     ngx_time_t  *time;
     ngx_msec_t   next;
+    ngx_uint_t   i, level;
+    ngx_http_accounting_stats_t  *stats, **entries;
 
     time = ngx_timeofday();
 
     ngx_http_accounting_old_time = ngx_http_accounting_new_time;
     ngx_http_accounting_new_time = time->sec;
 
-    ngx_http_accounting_hash_iterate(&stats_hash, worker_process_write_out_stats, NULL, NULL);
+    worker_process_progress_flush();
+
+    if (worker_process_cpu_mode == NGX_HTTP_ACCOUNTING_CPU_TSC) {
+        worker_process_cpu_calibrate();
+    }
+
+    // the gauges of every id start from its own requests, the subtree is added below
+    for (level = 1; worker_process_concurrency && level <= worker_process_depth; level++) {
+        for (stats = worker_process_levels[level - 1]; stats; stats = stats->next) {
+            stats->in_flight = stats->running;
+            stats->max_in_flight = stats->max_running;
+        }
+    }
+
+    // roll children up into their parents, deepest level first so that
+    // every parent already holds its whole subtree when it is added upwards
+    for (level = worker_process_depth; level > 1; level--) {
+        for (stats = worker_process_levels[level - 1]; stats; stats = stats->next) {
+            if (stats->nr_requests > 0 || stats->bytes_in > 0 || stats->bytes_out > 0
+                || stats->cpu_ns > 0 || stats->max_in_flight > 0)
+            {
+                // a parent keeps the top requests of its subtree
+                if (stats->top) {
+                    (void) worker_process_get_top(stats->parent);
+                }
+
+                ngx_http_accounting_stats_add(stats->parent, stats);
+            }
+        }
+    }
+
+    // collect every entry with traffic
+    worker_process_entries.nelts = 0;
+    ngx_http_accounting_hash_iterate(&stats_hash, worker_process_collect_stats,
+                                     &worker_process_entries, NULL);
+
+    for (i = 0; worker_process_registry && i < worker_process_registry->mph.n; i++) {
+        stats = worker_process_registry_stats[i];
+        if (stats == NULL) {
+            continue;
+        }
+
+        (void) worker_process_collect_stats(stats->name.data, stats->name.len, stats,
+                                            &worker_process_entries, NULL);
+    }
+
+    entries = worker_process_entries.elts;
+
+    // only the snapshot needs the ids sorted by name
+    if (worker_process_snapshot_path.len) {
+        ngx_qsort(entries, worker_process_entries.nelts, sizeof(ngx_http_accounting_stats_t *),
+                  worker_process_cmp_stats);
+
+        (void) ngx_http_accounting_snapshot_write(write_out_ev.log, &worker_process_snapshot_path,
+                                                  ngx_http_accounting_old_time,
+                                                  ngx_http_accounting_new_time,
+                                                  entries, worker_process_entries.nelts);
+    }
+
+    if (worker_process_export) {
+        ngx_http_accounting_exporter_export(write_out_ev.log, ngx_http_accounting_old_time,
+                                            ngx_http_accounting_new_time,
+                                            entries, worker_process_entries.nelts);
+    }
+
+    for (i = 0; worker_process_history && i < worker_process_entries.nelts; i++) {
+        ngx_http_accounting_history_add(worker_process_history, entries[i],
+                                        ngx_http_accounting_old_time);
+    }
+
+    for (i = 0; i < worker_process_entries.nelts; i++) {
+        if (entries[i]->slo) {
+            worker_process_slo_add(entries[i]);
+        }
+
+        worker_process_write_out_stats(entries[i]);
+        ngx_http_accounting_stats_reset(entries[i]);
+    }
+
+    if (worker_process_file) {
+        ngx_http_accounting_file_flush(write_out_ev.log);
+    }
 
     if (ngx_exiting || ev == NULL)
         return;
@@ -233,4 +1204,297 @@ create_accounting_id(u_char *key, int len)
     return (ngx_str_t) {len, buffer};
 }
 
+static ngx_int_t
+worker_process_init_registry(ngx_cycle_t *cycle, ngx_http_accounting_main_conf_t *amcf)
+{
+    ngx_uint_t  n;
+
+    worker_process_registry = amcf->registry;
+    n = worker_process_registry->mph.n;
+
+    // a pointer per id, the entries cost about 1 KB and the sketches once they see traffic
+    ngx_log_error(NGX_LOG_INFO, cycle->log, 0,
+                  "accounting registry of %ui ids, entries allocated on first use", n);
+
+    worker_process_registry_stats = ngx_pcalloc(cycle->pool, n * sizeof(ngx_http_accounting_stats_t *));
+    if (worker_process_registry_stats == NULL) {
+        return NGX_ERROR;
+    }
+
+    return NGX_OK;
+}
+
+// the entry of a registry id, created with its parents the first time it is seen
+static ngx_http_accounting_stats_t *
+worker_process_registry_get(ngx_uint_t slot)
+{
+    u_char      *p;
+    ngx_str_t    name, prefix;
+    ngx_uint_t   key, level;
+    ngx_http_accounting_stats_t  *stats, *parent;
+
+    if (worker_process_registry_stats[slot]) {
+        return worker_process_registry_stats[slot];
+    }
+
+    name = worker_process_registry->ids[slot];
+
+    for (level = 1, p = name.data; p < name.data + name.len; p++) {
+        level += (*p == '/');
+    }
+
+    parent = NULL;
 
+    if (level > 1) {
+        prefix = name;
+        while (prefix.data[--prefix.len] != '/') { /* void */ }
+
+        parent = worker_process_find_id(worker_process_amcf, &prefix, level - 1);
+        if (parent == NULL) {
+            return NULL;
+        }
+    }
+
+    // the name lives as long as the registry, and the entry is found by slot, not in the hash
+    key = ngx_hash_key_lc(name.data, name.len);
+
+    stats = worker_process_new_stats(worker_process_amcf, key, &name, level, parent);
+
+    worker_process_registry_stats[slot] = stats;
+
+    return stats;
+}
+
+/*
+ * overflow=other: an unknown id is counted in the "~other" below its longest
+ * prefix that is in the registry, as over a depth cap, or in the top level
+ * "~other" when no prefix is known.
+ */
+static ngx_http_accounting_stats_t *
+worker_process_registry_find_other(ngx_pool_t *pool, ngx_str_t *id)
+{
+    ngx_int_t    slot;
+    ngx_str_t    prefix;
+    ngx_http_accounting_stats_t  *parent;
+
+    prefix = *id;
+
+    while (prefix.len > 0) {
+        while (prefix.len > 0 && prefix.data[--prefix.len] != '/') { /* void */ }
+
+        if (prefix.len == 0) {
+            break;
+        }
+
+        slot = ngx_http_accounting_registry_find(worker_process_registry, prefix.data, prefix.len);
+
+        if (slot != NGX_ERROR) {
+            parent = worker_process_registry_get(slot);
+            if (parent == NULL) {
+                return NULL;
+            }
+
+            return worker_process_find_other(pool, parent, parent->level + 1);
+        }
+    }
+
+    return worker_process_find_other(pool, NULL, 1);
+}
+
+static ngx_http_accounting_stats_t *
+worker_process_lookup(ngx_uint_t key, ngx_str_t *name)
+{
+    ngx_int_t  slot;
+
+    if (worker_process_registry != NULL) {
+        slot = ngx_http_accounting_registry_find(worker_process_registry, name->data, name->len);
+        if (slot != NGX_ERROR) {
+            return worker_process_registry_get(slot);
+        }
+    }
+
+    return ngx_http_accounting_hash_find(&stats_hash, key, name->data, name->len);
+}
+
+// finds or creates the entry of an id and its parents, without cardinality caps
+static ngx_http_accounting_stats_t *
+worker_process_find_id(ngx_http_accounting_main_conf_t *amcf, ngx_str_t *name, ngx_uint_t level)
+{
+    ngx_str_t    prefix;
+    ngx_uint_t   key;
+    ngx_http_accounting_stats_t  *stats, *parent;
+
+    key = ngx_hash_key_lc(name->data, name->len);
+
+    stats = worker_process_lookup(key, name);
+    if (stats != NULL) {
+        return stats;
+    }
+
+    parent = NULL;
+
+    if (level > 1) {
+        prefix = *name;
+        while (prefix.data[--prefix.len] != '/') { /* void */ }
+
+        parent = worker_process_find_id(amcf, &prefix, level - 1);
+        if (parent == NULL) {
+            return NULL;
+        }
+    }
+
+    return worker_process_add_stats(amcf, key, name, level, parent);
+}
+
+static ngx_http_accounting_stats_t *
+worker_process_find_path(ngx_pool_t *pool, ngx_str_t *path)
+{
+    ngx_str_t    name;
+    ngx_uint_t   key, level, len;
+    ngx_http_accounting_stats_t  *stats, *parent;
+
+    parent = NULL;
+    len = 0;
+
+    for (level = 1; /* void */; level++) {
+        while (len < path->len && path->data[len] != '/') {
+            len++;
+        }
+
+        name.len = len;
+        name.data = path->data;
+
+        key = ngx_hash_key_lc(name.data, name.len);
+        stats = worker_process_lookup(key, &name);
+
+        if (stats == NULL) {
+            if (worker_process_level_caps[level - 1]
+                && worker_process_level_count[level - 1] >= worker_process_level_caps[level - 1])
+            {
+                return worker_process_find_other(pool, parent, level);
+            }
+
+            stats = worker_process_add_stats(worker_process_amcf, key, &name, level, parent);
+            if (stats == NULL) {
+                return NULL;
+            }
+        }
+
+        if (len >= path->len) {
+            return stats;
+        }
+
+        parent = stats;
+        len++;
+    }
+}
+
+static ngx_http_accounting_stats_t *
+worker_process_find_other(ngx_pool_t *pool, ngx_http_accounting_stats_t *parent, ngx_uint_t level)
+{
+    u_char      *p;
+    ngx_str_t    name;
+    ngx_uint_t   key;
+    ngx_http_accounting_stats_t  *stats, **other;
+
+    // every request of an id over the cap ends up here, the entry is kept at hand
+    other = parent ? &parent->other : &worker_process_other;
+
+    if (*other) {
+        return *other;
+    }
+
+    // '~' never shows up in a path part, so "~other" can not clash with a real one
+    name.len = sizeof("~other") - 1;
+    if (parent) {
+        name.len += parent->name.len + 1;
+    }
+
+    name.data = ngx_pnalloc(pool, name.len);
+    if (name.data == NULL) {
+        return NULL;
+    }
+
+    p = name.data;
+    if (parent) {
+        p = ngx_cpymem(p, parent->name.data, parent->name.len);
+        *p++ = '/';
+    }
+    ngx_memcpy(p, "~other", sizeof("~other") - 1);
+
+    key = ngx_hash_key_lc(name.data, name.len);
+    stats = ngx_http_accounting_hash_find(&stats_hash, key, name.data, name.len);
+
+    if (stats == NULL) {
+        stats = worker_process_add_stats(worker_process_amcf, key, &name, level, parent);
+    }
+
+    *other = stats;
+
+    return stats;
+}
+
+static ngx_http_accounting_stats_t *
+worker_process_add_stats(ngx_http_accounting_main_conf_t *amcf, ngx_uint_t key, ngx_str_t *name,
+    ngx_uint_t level, ngx_http_accounting_stats_t *parent)
+{
+    ngx_str_t                     id;
+    ngx_http_accounting_stats_t  *stats;
+
+    id = create_accounting_id(name->data, name->len);
+
+    stats = worker_process_new_stats(amcf, key, &id, level, parent);
+    if (stats == NULL)
+        return NULL;
+
+    if (ngx_http_accounting_hash_add(&stats_hash, key, stats->name.data, stats->name.len, stats)
+        != NGX_OK)
+    {
+        return NULL;
+    }
+
+    return stats;
+}
+
+// a zeroed entry of the id at the given level, on the list of its level; name is kept as is
+static ngx_http_accounting_stats_t *
+worker_process_new_stats(ngx_http_accounting_main_conf_t *amcf, ngx_uint_t key, ngx_str_t *name,
+    ngx_uint_t level, ngx_http_accounting_stats_t *parent)
+{
+    ngx_uint_t   i;
+    ngx_uint_t  *status_array;
+    ngx_http_accounting_stats_t  *stats;
+
+    stats = ngx_pcalloc(stats_hash.pool, sizeof(ngx_http_accounting_stats_t));
+    status_array = ngx_pcalloc(stats_hash.pool, sizeof(ngx_uint_t) * http_status_code_count);
+
+    if (stats == NULL || status_array == NULL)
+        return NULL;
+
+    for (i = 0; i < ngx_http_accounting_nr_distincts; i++) {
+        stats->distinct[i] = ngx_pcalloc(stats_hash.pool,
+                                         (size_t) 1 << ngx_http_accounting_distincts[i].precision);
+        if (stats->distinct[i] == NULL)
+            return NULL;
+    }
+
+    stats->name = *name;
+    stats->level = level;
+    stats->parent = parent;
+    stats->http_status_code = status_array;
+
+    // quotas are declared for top level ids and shared by the whole subtree
+    if (parent) {
+        stats->quota = parent->quota;
+    } else {
+        stats->quota = ngx_http_accounting_quota_find(amcf, key, name);
+    }
+
+    stats->slo = ngx_http_accounting_slo_find(amcf, key, name);
+
+    stats->next = worker_process_levels[level - 1];
+    worker_process_levels[level - 1] = stats;
+    worker_process_level_count[level - 1]++;
+
+    return stats;
+}
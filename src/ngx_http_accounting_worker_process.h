@@ -5,10 +5,47 @@
 #include <ngx_core.h>
 #include <ngx_http.h>
 
+#include "ngx_http_accounting_common.h"
+
+
+// a running request, for quotas, progressive accounting, the concurrency gauges and CPU time
+typedef struct {
+    ngx_queue_t                   queue;
+    ngx_http_request_t           *request;
+    ngx_http_accounting_stats_t  *stats;        /* of the id in preaccess, charged by the flushes */
+    off_t                         bytes_in;     /* charged so far */
+    off_t                         bytes_out;
+    uint64_t                      cpu_start;    /* clock in preaccess, if sampled */
+    unsigned                      quota:1;      /* checked against its quota in the access phase */
+    unsigned                      rejected:1;   /* by its quota */
+    unsigned                      sampled:1;    /* updates the sampled dimensions */
+} ngx_http_accounting_ctx_t;
+
+// what a finished request or stream session adds to its id
+typedef struct {
+    ngx_uint_t                    status;
+    off_t                         bytes_in;     /* not charged yet */
+    off_t                         bytes_out;
+    off_t                         size_in;      /* whole request, for the histograms and quotas */
+    off_t                         size_out;
+    ngx_msec_t                    latency_ms;
+    ngx_msec_t                    upstream_latency_ms;
+    ngx_msec_t                    upstream_connect_ms;
+    ngx_msec_t                    upstream_header_ms;
+    ngx_uint_t                    upstream_attempts;
+    ngx_uint_t                    upstream_retries;
+    ngx_uint_t                    upstream_errors;
+    unsigned                      reserved:1;   /* counted against its quota already */
+    unsigned                      rejected:1;   /* by its quota, not charged */
+} ngx_http_accounting_session_t;
 
 ngx_int_t ngx_http_accounting_worker_process_init(ngx_cycle_t *cycle);
 void ngx_http_accounting_worker_process_exit(ngx_cycle_t *cycle);
 
 ngx_int_t ngx_http_accounting_handler(ngx_http_request_t *r);
+ngx_int_t ngx_http_accounting_ctx_handler(ngx_http_request_t *r);
+ngx_int_t ngx_http_accounting_quota_handler(ngx_http_request_t *r);
+ngx_int_t ngx_http_accounting_account_session(ngx_pool_t *pool, ngx_str_t *id,
+    ngx_http_accounting_session_t *session);
 
 #endif /* _NGX_HTTP_ACCOUNTING_WORKER_PROCESS_H_INCLUDED_ */
@@ -0,0 +1,202 @@
+#include <ngx_config.h>
+#include <ngx_core.h>
+#include <ngx_stream.h>
+
+#include "ngx_http_accounting_worker_process.h"
+
+
+/*
+ * Accounting of TCP/UDP sessions. Sessions are charged to the table of the
+ * http module when they end, so they share its ids, lines, snapshots and
+ * exporters, and need "http_accounting on".
+ */
+
+typedef struct {
+    ngx_flag_t                   enable;
+    ngx_stream_complex_value_t  *accounting_id;
+} ngx_stream_accounting_srv_conf_t;
+
+
+static ngx_int_t ngx_stream_accounting_init(ngx_conf_t *cf);
+static ngx_int_t ngx_stream_accounting_handler(ngx_stream_session_t *s);
+
+static void *ngx_stream_accounting_create_srv_conf(ngx_conf_t *cf);
+static char *ngx_stream_accounting_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child);
+
+
+static ngx_str_t  ngx_stream_accounting_default_id = ngx_string("default");
+
+
+static ngx_command_t  ngx_stream_accounting_commands[] = {
+    { ngx_string("stream_accounting"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_FLAG,
+      ngx_conf_set_flag_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_accounting_srv_conf_t, enable),
+      NULL},
+
+    { ngx_string("stream_accounting_id"),
+      NGX_STREAM_MAIN_CONF|NGX_STREAM_SRV_CONF|NGX_CONF_TAKE1,
+      ngx_stream_set_complex_value_slot,
+      NGX_STREAM_SRV_CONF_OFFSET,
+      offsetof(ngx_stream_accounting_srv_conf_t, accounting_id),
+      NULL},
+
+    ngx_null_command
+};
+
+
+static ngx_stream_module_t  ngx_stream_accounting_module_ctx = {
+    NULL,                                   /* preconfiguration */
+    ngx_stream_accounting_init,             /* postconfiguration */
+
+    NULL,                                   /* create main configuration */
+    NULL,                                   /* init main configuration */
+
+    ngx_stream_accounting_create_srv_conf,  /* create server configuration */
+    ngx_stream_accounting_merge_srv_conf    /* merge server configuration */
+};
+
+
+ngx_module_t  ngx_stream_accounting_module = {
+    NGX_MODULE_V1,
+    &ngx_stream_accounting_module_ctx,      /* module context */
+    ngx_stream_accounting_commands,         /* module directives */
+    NGX_STREAM_MODULE,                      /* module type */
+    NULL,                                   /* init master */
+    NULL,                                   /* init module */
+    NULL,                                   /* init process */
+    NULL,                                   /* init thread */
+    NULL,                                   /* exit thread */
+    NULL,                                   /* exit process */
+    NULL,                                   /* exit master */
+    NGX_MODULE_V1_PADDING
+};
+
+
+static ngx_int_t
+ngx_stream_accounting_init(ngx_conf_t *cf)
+{
+    ngx_stream_handler_pt        *h;
+    ngx_stream_core_main_conf_t  *cmcf;
+
+    cmcf = ngx_stream_conf_get_module_main_conf(cf, ngx_stream_core_module);
+
+    h = ngx_array_push(&cmcf->phases[NGX_STREAM_LOG_PHASE].handlers);
+    if (h == NULL) {
+        return NGX_ERROR;
+    }
+
+    *h = ngx_stream_accounting_handler;
+
+    return NGX_OK;
+}
+
+
+/*
+ * The session duration is the latency; the upstream latency is the time
+ * sessions spent with the upstreams, the header time the time to their
+ * first byte. Attempts that never connected are upstream errors.
+ */
+static ngx_int_t
+ngx_stream_accounting_handler(ngx_stream_session_t *s)
+{
+    ngx_str_t                          id;
+    ngx_uint_t                         i;
+    ngx_time_t                        *tp;
+    ngx_stream_upstream_state_t       *state;
+    ngx_http_accounting_session_t      session;
+    ngx_stream_accounting_srv_conf_t  *ascf;
+
+    ascf = ngx_stream_get_module_srv_conf(s, ngx_stream_accounting_module);
+
+    if (!ascf->enable) {
+        return NGX_OK;
+    }
+
+    id = ngx_stream_accounting_default_id;
+
+    if (ascf->accounting_id != NULL) {
+        if (ngx_stream_complex_value(s, ascf->accounting_id, &id) != NGX_OK) {
+            return NGX_ERROR;
+        }
+
+        if (id.len == 0) {
+            id = ngx_stream_accounting_default_id;
+        }
+    }
+
+    ngx_memzero(&session, sizeof(ngx_http_accounting_session_t));
+
+    tp = ngx_timeofday();
+
+    session.status = s->status;
+    session.bytes_in = s->received;
+    session.bytes_out = s->connection->sent;
+    session.size_in = session.bytes_in;
+    session.size_out = session.bytes_out;
+    session.latency_ms = (tp->sec - s->start_sec) * 1000 + (tp->msec - s->start_msec);
+
+    if (s->upstream_states != NULL) {
+        state = s->upstream_states->elts;
+
+        for (i = 0; i < s->upstream_states->nelts; i++) {
+            if (state[i].peer == NULL) {
+                continue;
+            }
+
+            session.upstream_attempts++;
+
+            if (state[i].response_time != (ngx_msec_t) -1) {
+                session.upstream_latency_ms += state[i].response_time;
+            }
+            if (state[i].first_byte_time != (ngx_msec_t) -1) {
+                session.upstream_header_ms += state[i].first_byte_time;
+            }
+
+            if (state[i].connect_time == (ngx_msec_t) -1) {
+                session.upstream_errors++;
+            } else {
+                session.upstream_connect_ms += state[i].connect_time;
+            }
+        }
+
+        if (session.upstream_attempts > 1) {
+            session.upstream_retries = session.upstream_attempts - 1;
+        }
+    }
+
+    (void) ngx_http_accounting_account_session(s->connection->pool, &id, &session);
+
+    return NGX_OK;
+}
+
+
+static void *
+ngx_stream_accounting_create_srv_conf(ngx_conf_t *cf)
+{
+    ngx_stream_accounting_srv_conf_t  *conf;
+
+    conf = ngx_pcalloc(cf->pool, sizeof(ngx_stream_accounting_srv_conf_t));
+    if (conf == NULL) {
+        return NULL;
+    }
+
+    conf->enable = NGX_CONF_UNSET;
+    conf->accounting_id = NGX_CONF_UNSET_PTR;
+
+    return conf;
+}
+
+
+static char *
+ngx_stream_accounting_merge_srv_conf(ngx_conf_t *cf, void *parent, void *child)
+{
+    ngx_stream_accounting_srv_conf_t  *prev = parent;
+    ngx_stream_accounting_srv_conf_t  *conf = child;
+
+    ngx_conf_merge_value(conf->enable, prev->enable, 0);
+    ngx_conf_merge_ptr_value(conf->accounting_id, prev->accounting_id, NULL);
+
+    return NGX_CONF_OK;
+}
@@ -0,0 +1,71 @@
+/*
+ * Cost of http_accounting_cpu per request: the sampling decision, the clock
+ * reading in the preaccess phase and the one in the log phase with the charge
+ * to the id, as done by ngx_http_accounting_ctx_handler() and
+ * ngx_http_accounting_handler(), at sample rates of 1, 1/8 and 1/64. Not part
+ * of the tests, run it with make bench.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../src/ngx_http_accounting_cpu.h"
+
+#define ITERATIONS  2000000
+
+typedef struct {
+    unsigned  sampled;
+    uint64_t  cpu_start;
+} request_t;
+
+static double bench(unsigned mode, unsigned shift)
+{
+    request_t r;
+    volatile uint64_t cpu_ns = 0;
+    uint64_t start, end, count = 0;
+    unsigned i;
+
+    start = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+
+    for (i = 0; i < ITERATIONS; i++) {
+        // preaccess
+        r.sampled = (count++ & ((1 << shift) - 1)) == 0;
+
+        if (mode != NGX_HTTP_ACCOUNTING_CPU_OFF && r.sampled) {
+            r.cpu_start = ngx_http_accounting_cpu_clock(mode);
+        }
+
+        // log phase
+        if (mode != NGX_HTTP_ACCOUNTING_CPU_OFF && r.sampled) {
+            cpu_ns += ngx_http_accounting_cpu_elapsed(r.cpu_start, mode, 1.0);
+        }
+    }
+
+    end = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+
+    return (double) (end - start) / ITERATIONS;
+}
+
+int main()
+{
+    static const struct {
+        const char *name;
+        unsigned mode;
+    } modes[] = {
+        { "off", NGX_HTTP_ACCOUNTING_CPU_OFF },
+        { "thread", NGX_HTTP_ACCOUNTING_CPU_THREAD },
+#if defined(__x86_64__) || defined(__i386__)
+        { "tsc", NGX_HTTP_ACCOUNTING_CPU_TSC },
+#endif
+    };
+    unsigned i;
+
+    printf("%-10s %12s %12s %12s\n", "mode", "rate 1", "rate 1/8", "rate 1/64");
+
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        printf("%-10s %9.1f ns %9.1f ns %9.1f ns\n", modes[i].name,
+               bench(modes[i].mode, 0), bench(modes[i].mode, 3), bench(modes[i].mode, 6));
+    }
+
+    return 0;
+}
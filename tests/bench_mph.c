@@ -0,0 +1,91 @@
+/*
+ * Startup cost of http_accounting_registry for 1M ids: building the minimal
+ * perfect hash, which the master does at configuration time, the lookup
+ * cost and the memory of every worker: the pointer per id that
+ * worker_process_init_registry() allocates and the entry of every id that
+ * sees traffic. Not part of the tests, run it with make bench.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../src/ngx_http_accounting_hll.h"
+#include "../src/ngx_http_accounting_mph.h"
+
+#define NR_KEYS  1000000
+
+/*
+ * sizeof(ngx_http_accounting_stats_t) on LP64 (see
+ * ngx_http_accounting_common.h) and its status code counters, one word for
+ * each of the 35 codes in ngx_http_accounting_status_code.c.
+ */
+#define STATS_SIZE         736
+#define STATUS_CODES_SIZE  (35 * 8)
+
+static double now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main()
+{
+    static uint64_t hashes[NR_KEYS];
+    static uint32_t slots[NR_KEYS];
+    ngx_http_accounting_mph_t mph;
+    volatile uint32_t sink = 0;
+    double start, hashed, built, looked_up;
+    size_t per_id;
+    char key[32];
+    int i, len, sketches;
+
+    start = now_ms();
+
+    for (i = 0; i < NR_KEYS; i++) {
+        len = snprintf(key, sizeof(key), "tenant-%d", i);
+        hashes[i] = ngx_http_accounting_hll_hash(key, len);
+    }
+
+    hashed = now_ms();
+
+    if (ngx_http_accounting_mph_build(&mph, hashes, NR_KEYS, slots) != 0) {
+        fprintf(stderr, "build failed\n");
+        return 1;
+    }
+
+    built = now_ms();
+
+    for (i = 0; i < NR_KEYS; i++) {
+        sink += ngx_http_accounting_mph_slot(&mph, hashes[i]);
+    }
+
+    looked_up = now_ms();
+
+    (void) sink;
+
+    printf("%d ids\n", NR_KEYS);
+    printf("  hashing the ids       %8.1f ms\n", hashed - start);
+    printf("  building the hash     %8.1f ms\n", built - hashed);
+    printf("  lookup                %8.1f ns\n", (looked_up - built) * 1e6 / NR_KEYS);
+    printf("  hash size             %8.1f MB\n", mph.nr_buckets * sizeof(uint32_t) / 1e6);
+
+    printf("per worker\n");
+    printf("  at startup            %8zu B per id %8.1f MB\n", sizeof(void *),
+           (double) sizeof(void *) * NR_KEYS / 1e6);
+
+    for (sketches = 0; sketches <= 2; sketches++) {
+        // with the default size=4k of http_accounting_distinct
+        per_id = STATS_SIZE + STATUS_CODES_SIZE + sketches * 4096;
+
+        printf("  %d distinct sketches   %8zu B per used id, %8.1f MB if all are\n", sketches,
+               per_id, (double) per_id * NR_KEYS / 1e6);
+    }
+
+    ngx_http_accounting_mph_free(&mph);
+
+    return 0;
+}
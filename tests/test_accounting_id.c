@@ -4,6 +4,7 @@
 #include "../src/ngx_http_accounting_prefix.h"
 
 ngx_str_t create_request_and_get_prefix(char uri[], int len);
+ngx_str_t create_request_and_get_path(char uri[], int len, u_int depth);
 
 void test_extract_prefix_from_request_with_only_prefix(void)
 {
@@ -11,7 +12,7 @@ void test_extract_prefix_from_request_with_only_prefix(void)
     char expected_result[] = "prefix";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
 }
 
 void test_extract_prefix_from_request_terminates_on_slash(void)
@@ -21,7 +22,7 @@ void test_extract_prefix_from_request_terminates_on_slash(void)
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
     char result_prefix[result.len + 1];
-    strncpy(result_prefix, result.data, result.len);
+    strncpy(result_prefix, (char *) result.data, result.len);
     result_prefix[result.len] = '\0';
 
     assert(strcmp(expected_result, result_prefix) == 0);
@@ -34,7 +35,7 @@ void test_extract_prefix_from_request_does_not_terminate_on_dash(void)
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
     char result_prefix[result.len + 1];
-    strncpy(result_prefix, result.data, result.len);
+    strncpy(result_prefix, (char *) result.data, result.len);
     result_prefix[result.len] = '\0';
     assert(strcmp(expected_result, result_prefix) == 0);
 }
@@ -45,7 +46,7 @@ void test_extract_prefix_from_request_returns_default_on_slash(void)
     char expected_result[] = "default";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
 }
 
 void test_extract_prefix_from_request_returns_malformed_request_on_empty(void)
@@ -54,7 +55,7 @@ void test_extract_prefix_from_request_returns_malformed_request_on_empty(void)
     char expected_result[] = "malformed-request";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
 }
 
 void test_extract_prefix_from_request_returns_malformed_request_on_null(void)
@@ -63,7 +64,7 @@ void test_extract_prefix_from_request_returns_malformed_request_on_null(void)
     char expected_result[] = "malformed-request";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
 }
 
 void test_extract_prefix_from_request_returns_malformed_request_if_prefix_does_not_start_with_slash(void)
@@ -72,7 +73,7 @@ void test_extract_prefix_from_request_returns_malformed_request_if_prefix_does_n
     char expected_result[] = "malformed-request";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
 }
 
 void test_extract_namespace_from_request_rest_schema(void)
@@ -81,7 +82,7 @@ void test_extract_namespace_from_request_rest_schema(void)
     char expected_result[] =  "namespace";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
 }
 
 void test_extract_prefix_from_request_addons_schema(void)
@@ -90,7 +91,7 @@ void test_extract_prefix_from_request_addons_schema(void)
     char expected_result[] =  "namespace";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
 }
 
 void test_extract_prefix_from_request_private_schema(void)
@@ -99,7 +100,7 @@ void test_extract_prefix_from_request_private_schema(void)
     char expected_result[] =  "namespace";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
 }
 
 void test_extract_prefix_from_request_rest_schema_without_namespace_returns_empty(void)
@@ -108,14 +109,79 @@ void test_extract_prefix_from_request_rest_schema_without_namespace_returns_empt
     char expected_result[] =  "";
     ngx_str_t result = create_request_and_get_prefix(test_location, sizeof(test_location));
 
-    assert(strcmp(expected_result, result.data) == 0);
+    assert(strcmp(expected_result, (char *) result.data) == 0);
+}
+
+void test_extract_path_from_request_stops_at_depth(void)
+{
+    char test_location[] = "/rest/namespace/endpoint/1/more";
+    char expected_result[] = "namespace/endpoint/1";
+    ngx_str_t result = create_request_and_get_path(test_location, sizeof(test_location), 3);
+
+    char result_path[result.len + 1];
+    strncpy(result_path, (char *) result.data, result.len);
+    result_path[result.len] = '\0';
+    assert(strcmp(expected_result, result_path) == 0);
+}
+
+void test_extract_path_from_request_shorter_than_depth(void)
+{
+    char test_location[] = "/prefix/endpoint?query=1";
+    char expected_result[] = "prefix/endpoint";
+    ngx_str_t result = create_request_and_get_path(test_location, sizeof(test_location), 4);
+
+    char result_path[result.len + 1];
+    strncpy(result_path, (char *) result.data, result.len);
+    result_path[result.len] = '\0';
+    assert(strcmp(expected_result, result_path) == 0);
+}
+
+void test_extract_path_from_request_with_depth_one_returns_prefix(void)
+{
+    char test_location[] = "/prefix/endpoint";
+    char expected_result[] = "prefix";
+    ngx_str_t result = create_request_and_get_path(test_location, sizeof(test_location), 1);
+
+    char result_path[result.len + 1];
+    strncpy(result_path, (char *) result.data, result.len);
+    result_path[result.len] = '\0';
+    assert(strcmp(expected_result, result_path) == 0);
+}
+
+void test_extract_path_from_request_stops_at_double_slash(void)
+{
+    char test_location[] = "/prefix//endpoint";
+    char expected_result[] = "prefix";
+    ngx_str_t result = create_request_and_get_path(test_location, sizeof(test_location), 3);
+
+    char result_path[result.len + 1];
+    strncpy(result_path, (char *) result.data, result.len);
+    result_path[result.len] = '\0';
+    assert(strcmp(expected_result, result_path) == 0);
+}
+
+void test_extract_path_from_request_returns_default_on_slash(void)
+{
+    char test_location[] = "/";
+    char expected_result[] = "default";
+    ngx_str_t result = create_request_and_get_path(test_location, sizeof(test_location), 3);
+
+    assert(strcmp(expected_result, (char *) result.data) == 0);
+}
+
+ngx_str_t create_request_and_get_path(char uri[], int len, u_int depth)
+{
+    ngx_http_request_t request;
+    request.uri.data = (u_char *) uri;
+    request.uri.len = len;
+    return extract_routing_path(&request, depth);
 }
 
 ngx_str_t create_request_and_get_prefix(char uri[], int len)
 {
     ngx_str_t result;
     ngx_http_request_t request;
-    request.uri.data = uri;
+    request.uri.data = (u_char *) uri;
     request.uri.len = len;
     result = extract_routing_prefix(&request);
     return result;
@@ -135,6 +201,11 @@ int main()
     test_extract_prefix_from_request_addons_schema();
     test_extract_prefix_from_request_private_schema();
     test_extract_prefix_from_request_rest_schema_without_namespace_returns_empty();
+    test_extract_path_from_request_stops_at_depth();
+    test_extract_path_from_request_shorter_than_depth();
+    test_extract_path_from_request_with_depth_one_returns_prefix();
+    test_extract_path_from_request_stops_at_double_slash();
+    test_extract_path_from_request_returns_default_on_slash();
     printf("Tests passed!\n");
     return 0;
 }
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "../src/ngx_http_accounting_cpu.h"
+
+void spin(void)
+{
+    volatile unsigned long n = 0;
+
+    while (n < 1000000) {
+        n++;
+    }
+}
+
+void test_cpu_elapsed_is_within_the_readings(void)
+{
+    uint64_t before, start, elapsed, after;
+
+    before = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+    start = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+    spin();
+    elapsed = ngx_http_accounting_cpu_elapsed(start, NGX_HTTP_ACCOUNTING_CPU_OFF, 1.0);
+    after = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+
+    assert(elapsed > 0 && elapsed <= after - before);
+}
+
+void test_cpu_thread_clock_counts_cpu_time(void)
+{
+    uint64_t start, elapsed;
+
+    start = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_THREAD);
+    spin();
+    elapsed = ngx_http_accounting_cpu_elapsed(start, NGX_HTTP_ACCOUNTING_CPU_THREAD, 1.0);
+
+    assert(elapsed > 0);
+}
+
+void test_cpu_elapsed_is_scaled(void)
+{
+    uint64_t start, now, elapsed;
+
+    start = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+    spin();
+    elapsed = ngx_http_accounting_cpu_elapsed(start, NGX_HTTP_ACCOUNTING_CPU_OFF, 0.5);
+    now = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+
+    assert(elapsed > 0 && elapsed <= (now - start) / 2 + 1);
+}
+
+void test_cpu_clock_going_back_counts_nothing(void)
+{
+    uint64_t now = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+
+    assert(ngx_http_accounting_cpu_elapsed(now + 1000000000, NGX_HTTP_ACCOUNTING_CPU_OFF, 1.0) == 0);
+}
+
+void test_cpu_clocks_advance(void)
+{
+    uint64_t thread = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_THREAD);
+    uint64_t monotonic = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF);
+    uint64_t tsc = ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_TSC);
+
+    spin();
+
+    assert(ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_THREAD) > thread);
+    assert(ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_OFF) > monotonic);
+    assert(ngx_http_accounting_cpu_clock(NGX_HTTP_ACCOUNTING_CPU_TSC) > tsc);
+}
+
+int main()
+{
+    test_cpu_elapsed_is_within_the_readings();
+    test_cpu_thread_clock_counts_cpu_time();
+    test_cpu_elapsed_is_scaled();
+    test_cpu_clock_going_back_counts_nothing();
+    test_cpu_clocks_advance();
+    printf("Tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "../src/ngx_http_accounting_hll.h"
+
+uint64_t add_addresses(uint8_t *registers, unsigned precision, int from, int to)
+{
+    char address[32];
+    int i;
+
+    for (i = from; i < to; i++) {
+        int len = snprintf(address, sizeof(address), "10.%d.%d.%d", (i >> 16) & 255, (i >> 8) & 255, i & 255);
+        ngx_http_accounting_hll_add(registers, precision, ngx_http_accounting_hll_hash(address, len));
+    }
+
+    return ngx_http_accounting_hll_estimate(registers, precision);
+}
+
+int within(uint64_t estimate, uint64_t expected, double error)
+{
+    double diff = (double) estimate - (double) expected;
+    return (diff < 0 ? -diff : diff) <= error * expected;
+}
+
+void test_hll_empty_sketch_estimates_zero(void)
+{
+    uint8_t registers[1 << 10];
+    memset(registers, 0, sizeof(registers));
+
+    assert(ngx_http_accounting_hll_estimate(registers, 10) == 0);
+}
+
+void test_hll_small_cardinality_is_nearly_exact(void)
+{
+    uint8_t registers[1 << 12];
+    memset(registers, 0, sizeof(registers));
+
+    assert(within(add_addresses(registers, 12, 0, 100), 100, 0.02));
+}
+
+void test_hll_duplicates_do_not_count(void)
+{
+    uint8_t registers[1 << 12];
+    memset(registers, 0, sizeof(registers));
+
+    add_addresses(registers, 12, 0, 1000);
+    assert(within(add_addresses(registers, 12, 0, 1000), 1000, 0.05));
+}
+
+void test_hll_large_cardinality_within_error(void)
+{
+    uint8_t registers[1 << 14];
+    memset(registers, 0, sizeof(registers));
+
+    // standard error is 1.04 / sqrt(2^14), about 0.8%
+    assert(within(add_addresses(registers, 14, 0, 500000), 500000, 0.03));
+}
+
+void test_hll_merge_equals_union(void)
+{
+    uint8_t one[1 << 12], two[1 << 12], both[1 << 12];
+    memset(one, 0, sizeof(one));
+    memset(two, 0, sizeof(two));
+    memset(both, 0, sizeof(both));
+
+    add_addresses(one, 12, 0, 60000);
+    add_addresses(two, 12, 40000, 100000);
+    add_addresses(both, 12, 0, 100000);
+
+    ngx_http_accounting_hll_merge(one, two, 12);
+
+    assert(memcmp(one, both, sizeof(both)) == 0);
+    assert(within(ngx_http_accounting_hll_estimate(one, 12), 100000, 0.05));
+}
+
+int main()
+{
+    test_hll_empty_sketch_estimates_zero();
+    test_hll_small_cardinality_is_nearly_exact();
+    test_hll_duplicates_do_not_count();
+    test_hll_large_cardinality_within_error();
+    test_hll_merge_equals_union();
+    printf("Tests passed!\n");
+    return 0;
+}
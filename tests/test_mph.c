@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "../src/ngx_http_accounting_hll.h"
+#include "../src/ngx_http_accounting_mph.h"
+
+#define NR_KEYS  100000
+
+uint64_t key_hash(int i)
+{
+    char key[32];
+    int len = snprintf(key, sizeof(key), "tenant-%d", i);
+    return ngx_http_accounting_hll_hash(key, len);
+}
+
+void test_mph_maps_keys_to_distinct_slots(void)
+{
+    static uint64_t hashes[NR_KEYS];
+    static uint32_t slots[NR_KEYS];
+    static uint8_t seen[NR_KEYS];
+    ngx_http_accounting_mph_t mph;
+    int i;
+
+    for (i = 0; i < NR_KEYS; i++) {
+        hashes[i] = key_hash(i);
+    }
+
+    assert(ngx_http_accounting_mph_build(&mph, hashes, NR_KEYS, slots) == 0);
+
+    for (i = 0; i < NR_KEYS; i++) {
+        assert(slots[i] < NR_KEYS);
+        assert(!seen[slots[i]]);
+        seen[slots[i]] = 1;
+        assert(ngx_http_accounting_mph_slot(&mph, hashes[i]) == slots[i]);
+    }
+
+    // unknown keys land on some slot, the caller compares the id stored there
+    for (i = NR_KEYS; i < 2 * NR_KEYS; i++) {
+        assert(ngx_http_accounting_mph_slot(&mph, key_hash(i)) < NR_KEYS);
+    }
+
+    ngx_http_accounting_mph_free(&mph);
+}
+
+void test_mph_small_sets(void)
+{
+    uint64_t hashes[3];
+    uint32_t slots[3];
+    ngx_http_accounting_mph_t mph;
+    int n, i;
+
+    for (n = 1; n <= 3; n++) {
+        hashes[n - 1] = key_hash(n);
+        assert(ngx_http_accounting_mph_build(&mph, hashes, n, slots) == 0);
+        for (i = 0; i < n; i++) {
+            assert(ngx_http_accounting_mph_slot(&mph, hashes[i]) == slots[i]);
+        }
+        ngx_http_accounting_mph_free(&mph);
+    }
+}
+
+void test_mph_rejects_duplicate_hashes(void)
+{
+    uint64_t hashes[] = { 1, 2, 3, 2 };
+    uint32_t slots[4];
+    ngx_http_accounting_mph_t mph;
+
+    // both keys with hash 2 end up in the same bucket and on the same slot for every displacement
+    assert(ngx_http_accounting_mph_build(&mph, hashes, 4, slots) == -2);
+}
+
+int main()
+{
+    test_mph_maps_keys_to_distinct_slots();
+    test_mph_small_sets();
+    test_mph_rejects_duplicate_hashes();
+    printf("Tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,490 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "../src/ngx_http_accounting_otlp.h"
+
+/* a minimal protobuf reader, just enough to walk the encoded request */
+
+typedef struct {
+    const uint8_t *p;
+    const uint8_t *end;
+} reader_t;
+
+typedef struct {
+    unsigned field;
+    unsigned type;
+    uint64_t value;             /* varint and fixed64 */
+    const uint8_t *data;        /* length delimited */
+    size_t len;
+} field_t;
+
+uint64_t read_varint(reader_t *r)
+{
+    uint64_t v = 0;
+    int shift = 0;
+
+    for ( ;; ) {
+        assert(r->p < r->end);
+        uint8_t b = *r->p++;
+        v |= (uint64_t) (b & 0x7f) << shift;
+        if (!(b & 0x80)) {
+            return v;
+        }
+        shift += 7;
+        assert(shift < 64);
+    }
+}
+
+int next_field(reader_t *r, field_t *f)
+{
+    uint64_t tag;
+    int i;
+
+    if (r->p == r->end) {
+        return 0;
+    }
+
+    tag = read_varint(r);
+    f->field = tag >> 3;
+    f->type = tag & 7;
+
+    switch (f->type) {
+    case 0:
+        f->value = read_varint(r);
+        break;
+    case 1:
+        assert(r->end - r->p >= 8);
+        f->value = 0;
+        for (i = 0; i < 8; i++) {
+            f->value |= (uint64_t) r->p[i] << (8 * i);
+        }
+        r->p += 8;
+        break;
+    case 2:
+        f->len = read_varint(r);
+        assert((size_t) (r->end - r->p) >= f->len);
+        f->data = r->p;
+        r->p += f->len;
+        break;
+    default:
+        assert(0);
+    }
+
+    return 1;
+}
+
+reader_t sub_reader(field_t *f)
+{
+    reader_t r = { f->data, f->data + f->len };
+    assert(f->type == 2);
+    return r;
+}
+
+int field_is(field_t *f, const char *s)
+{
+    return f->type == 2 && f->len == strlen(s) && memcmp(f->data, s, f->len) == 0;
+}
+
+/* KeyValue: returns 1 if the key matches, the string or int value in *value / *n */
+int read_attribute(field_t *kv, const char *key, field_t *value)
+{
+    reader_t r = sub_reader(kv), any;
+    field_t f;
+    int match = 0;
+
+    while (next_field(&r, &f)) {
+        if (f.field == 1) {
+            match = field_is(&f, key);
+        } else if (f.field == 2) {
+            any = sub_reader(&f);
+            assert(next_field(&any, value));
+        }
+    }
+
+    return match;
+}
+
+/* test data: three ids, requests, responses by class, in flight and sizes */
+
+static const char *const classes[] = { "2xx", "4xx", "5xx" };
+static const double bounds[] = { 0, 1 };
+
+static const ngx_http_accounting_otlp_metric_t metrics[] = {
+    { "nginx.accounting.requests", "{request}", NGX_HTTP_ACCOUNTING_OTLP_SUM, 1, NULL, NULL },
+    { "nginx.accounting.responses", "{response}", NGX_HTTP_ACCOUNTING_OTLP_SUM, 3,
+      "http.status_class", classes },
+    { "nginx.accounting.in_flight", "{request}", NGX_HTTP_ACCOUNTING_OTLP_GAUGE, 1, NULL, NULL },
+    { "nginx.accounting.request.size", "By", NGX_HTTP_ACCOUNTING_OTLP_HISTOGRAM, 3, NULL, NULL,
+      bounds },
+};
+
+#define NR_METRICS  4
+
+static const uint64_t values[3][8] = {
+    { 10, 7, 2, 1, 3, 4, 5, 1 },
+    { 200, 190, 10, 0, 0, 0, 0, 200 },
+    { 1ULL << 40, 1, 0, 0, 12345, 1ULL << 40, 0, 0 },
+};
+
+static ngx_http_accounting_otlp_row_t rows[3];
+
+static const ngx_http_accounting_otlp_resource_t resource = {
+    "nginx", "host-1", 4242, 1700000000000000000ULL, 1700000010000000000ULL
+};
+
+size_t encode(uint8_t **out)
+{
+    static const char *ids[] = { "api", "api/v1", "static" };
+    size_t len, check;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        rows[i].id = (const uint8_t *) ids[i];
+        rows[i].id_len = strlen(ids[i]);
+        rows[i].level = i == 1 ? 2 : 1;
+        rows[i].values = values[i];
+    }
+
+    len = ngx_http_accounting_otlp_encode(NULL, 0, &resource, metrics, NR_METRICS, rows, 3);
+    assert(len != (size_t) -1 && len > 0);
+
+    *out = malloc(len);
+    check = ngx_http_accounting_otlp_encode(*out, len, &resource, metrics, NR_METRICS, rows, 3);
+    assert(check == len);
+
+    return len;
+}
+
+/* checks a HistogramDataPoint against the buckets of a row */
+void check_histogram_point(reader_t *dp, const ngx_http_accounting_otlp_metric_t *expected,
+    int row, int offset)
+{
+    reader_t packed;
+    field_t h, value;
+    uint64_t count = 0, bucket;
+    double bound;
+    unsigned k;
+    int has_id = 0, has_counts = 0, has_bounds = 0;
+
+    while (next_field(dp, &h)) {
+        if (h.field == 2) {
+            assert(h.value == resource.from_ns);
+        } else if (h.field == 3) {
+            assert(h.value == resource.to_ns);
+        } else if (h.field == 4) {
+            assert(h.type == 1);
+            count = h.value;
+        } else if (h.field == 6) {
+            packed = sub_reader(&h);
+            assert(packed.end - packed.p == 8 * (int) expected->width);
+            for (k = 0; k < expected->width; k++) {
+                memcpy(&bucket, packed.p + 8 * k, 8);
+                assert(bucket == values[row][offset + k]);
+            }
+            has_counts = 1;
+        } else if (h.field == 7) {
+            packed = sub_reader(&h);
+            assert(packed.end - packed.p == 8 * (int) (expected->width - 1));
+            for (k = 0; k + 1 < expected->width; k++) {
+                memcpy(&bound, packed.p + 8 * k, 8);
+                assert(bound == expected->bounds[k]);
+            }
+            has_bounds = 1;
+        } else if (h.field == 9) {
+            if (read_attribute(&h, "accounting.id", &value)) {
+                assert(value.len == rows[row].id_len);
+                assert(memcmp(value.data, rows[row].id, value.len) == 0);
+                has_id = 1;
+            }
+        } else {
+            assert(0);
+        }
+    }
+
+    for (k = 0, bucket = 0; k < expected->width; k++) {
+        bucket += values[row][offset + k];
+    }
+
+    assert(count == bucket);
+    assert(has_id && has_counts && has_bounds);
+}
+
+/* checks a decoded ExportMetricsServiceRequest against the test data */
+void check_request(const uint8_t *data, size_t len)
+{
+    reader_t req = { data, data + len }, rm, res, sm, metric, body, dp;
+    field_t f, g, h, kv, value;
+    int nr_resource_metrics = 0, nr_metrics = 0, service = 0, pid = 0, offset = 0;
+
+    while (next_field(&req, &f)) {
+        assert(f.field == 1);
+        nr_resource_metrics++;
+        rm = sub_reader(&f);
+
+        while (next_field(&rm, &g)) {
+            if (g.field == 1) {
+                res = sub_reader(&g);
+                while (next_field(&res, &kv)) {
+                    if (read_attribute(&kv, "service.name", &value)) {
+                        assert(field_is(&value, "nginx"));
+                        service = 1;
+                    }
+                    if (read_attribute(&kv, "process.pid", &value)) {
+                        assert(value.field == 3 && value.value == 4242);
+                        pid = 1;
+                    }
+                }
+                continue;
+            }
+
+            assert(g.field == 2);
+            sm = sub_reader(&g);
+
+            while (next_field(&sm, &h)) {
+                if (h.field == 1) {
+                    continue;
+                }
+
+                assert(h.field == 2);
+                metric = sub_reader(&h);
+
+                const ngx_http_accounting_otlp_metric_t *expected = &metrics[nr_metrics];
+                int histogram = expected->kind == NGX_HTTP_ACCOUNTING_OTLP_HISTOGRAM;
+                int nr_points = 0, temporality = 0, monotonic = 0, name = 0;
+
+                while (next_field(&metric, &f)) {
+                    if (f.field == 1) {
+                        assert(field_is(&f, expected->name));
+                        name = 1;
+                    }
+
+                    if (f.field != 5 && f.field != 7 && f.field != 9) {
+                        continue;
+                    }
+
+                    assert(f.field == (histogram ? 9u
+                                       : expected->kind == NGX_HTTP_ACCOUNTING_OTLP_SUM ? 7u : 5u));
+                    body = sub_reader(&f);
+
+                    while (next_field(&body, &g)) {
+                        if (g.field == 2) {
+                            temporality = (int) g.value;
+                            continue;
+                        }
+                        if (g.field == 3) {
+                            monotonic = (int) g.value;
+                            continue;
+                        }
+
+                        assert(g.field == 1);
+                        dp = sub_reader(&g);
+
+                        if (histogram) {
+                            check_histogram_point(&dp, expected, nr_points, offset);
+                            nr_points++;
+                            continue;
+                        }
+
+                        int row = nr_points / expected->width;
+                        int k = nr_points % expected->width;
+                        int has_id = 0, has_variant = expected->variants == NULL, has_start = 0;
+                        uint64_t v = 0;
+
+                        while (next_field(&dp, &h)) {
+                            if (h.field == 2) {
+                                assert(h.value == resource.from_ns);
+                                has_start = 1;
+                            } else if (h.field == 3) {
+                                assert(h.value == resource.to_ns);
+                            } else if (h.field == 6) {
+                                assert(h.type == 1);
+                                v = h.value;
+                            } else if (h.field == 7) {
+                                if (read_attribute(&h, "accounting.id", &value)) {
+                                    assert(value.len == rows[row].id_len);
+                                    assert(memcmp(value.data, rows[row].id, value.len) == 0);
+                                    has_id = 1;
+                                }
+                                if (expected->variants
+                                    && read_attribute(&h, expected->variant_key, &value))
+                                {
+                                    assert(field_is(&value, expected->variants[k]));
+                                    has_variant = 1;
+                                }
+                            }
+                        }
+
+                        assert(v == values[row][offset + k]);
+                        assert(has_id && has_variant);
+                        assert(has_start == (expected->kind == NGX_HTTP_ACCOUNTING_OTLP_SUM));
+                        nr_points++;
+                    }
+                }
+
+                assert(name);
+                assert(nr_points == 3 * (histogram ? 1 : (int) expected->width));
+
+                if (expected->kind == NGX_HTTP_ACCOUNTING_OTLP_SUM) {
+                    assert(temporality == 1 && monotonic == 1);
+                }
+
+                if (histogram) {
+                    assert(temporality == 1 && monotonic == 0);
+                }
+
+                offset += expected->width;
+                nr_metrics++;
+            }
+        }
+    }
+
+    assert(nr_resource_metrics == 1);
+    assert(nr_metrics == NR_METRICS);
+    assert(service && pid);
+}
+
+void test_otlp_encode_sizes_and_decodes(void)
+{
+    uint8_t *buf;
+    size_t len = encode(&buf);
+
+    check_request(buf, len);
+
+    free(buf);
+}
+
+void test_otlp_encode_reports_short_buffers(void)
+{
+    uint8_t small[64];
+    size_t len;
+
+    len = ngx_http_accounting_otlp_encode(small, sizeof(small), &resource, metrics, NR_METRICS,
+                                          rows, 3);
+    assert(len > sizeof(small) && len != (size_t) -1);
+}
+
+void test_pb_padded_lengths(void)
+{
+    uint8_t buf[16];
+    ngx_http_accounting_pb_t pb;
+
+    ngx_http_accounting_pb_init(&pb, buf, sizeof(buf));
+    ngx_http_accounting_pb_begin(&pb, 1);
+    ngx_http_accounting_pb_varint(&pb, 1, 300);
+    ngx_http_accounting_pb_end(&pb);
+
+    /* tag, 4 byte length 3, tag, varint 300 */
+    assert(pb.len == 1 + 4 + 1 + 2);
+    assert(buf[0] == 0x0a);
+    assert(buf[1] == 0x83 && buf[2] == 0x80 && buf[3] == 0x80 && buf[4] == 0x00);
+    assert(buf[5] == 0x08 && buf[6] == 0xac && buf[7] == 0x02);
+}
+
+/* a stand-in collector: accepts one POST, decodes and checks it, answers 200 */
+
+static int listener;
+
+void *collector(void *arg)
+{
+    char request[1 << 16];
+    size_t len = 0;
+    char *body, *cl;
+    size_t content_length;
+    ssize_t n;
+    int c;
+    const char *ok = "HTTP/1.1 200 OK\r\nContent-Length: 0\r\n\r\n";
+
+    (void) arg;
+
+    c = accept(listener, NULL, NULL);
+    assert(c >= 0);
+
+    for ( ;; ) {
+        n = read(c, request + len, sizeof(request) - 1 - len);
+        assert(n > 0);
+        len += n;
+        request[len] = '\0';
+
+        body = strstr(request, "\r\n\r\n");
+        if (body == NULL) {
+            continue;
+        }
+
+        body += 4;
+        cl = strstr(request, "Content-Length: ");
+        assert(cl != NULL && cl < body);
+        content_length = strtoul(cl + 16, NULL, 10);
+
+        if ((size_t) (request + len - body) >= content_length) {
+            break;
+        }
+    }
+
+    assert(strncmp(request, "POST /v1/metrics HTTP/1.1\r\n", 27) == 0);
+    assert(strstr(request, "Content-Type: application/x-protobuf\r\n") != NULL);
+
+    check_request((uint8_t *) body, content_length);
+
+    assert(write(c, ok, strlen(ok)) == (ssize_t) strlen(ok));
+    close(c);
+
+    return NULL;
+}
+
+void test_otlp_post_to_collector(void)
+{
+    struct sockaddr_in sin;
+    socklen_t slen = sizeof(sin);
+    pthread_t thread;
+    uint8_t *buf;
+    char header[512], response[256];
+    size_t len, hlen;
+    ssize_t n;
+    int s;
+
+    listener = socket(AF_INET, SOCK_STREAM, 0);
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    assert(bind(listener, (struct sockaddr *) &sin, sizeof(sin)) == 0);
+    assert(listen(listener, 1) == 0);
+    assert(getsockname(listener, (struct sockaddr *) &sin, &slen) == 0);
+
+    assert(pthread_create(&thread, NULL, collector, NULL) == 0);
+
+    len = encode(&buf);
+    hlen = ngx_http_accounting_otlp_request(header, sizeof(header), "127.0.0.1", "/v1/metrics", len);
+    assert(hlen > 0);
+
+    s = socket(AF_INET, SOCK_STREAM, 0);
+    assert(connect(s, (struct sockaddr *) &sin, sizeof(sin)) == 0);
+    assert(write(s, header, hlen) == (ssize_t) hlen);
+    assert(write(s, buf, len) == (ssize_t) len);
+
+    n = read(s, response, sizeof(response) - 1);
+    assert(n >= 12);
+    response[n] = '\0';
+    assert(strncmp(response, "HTTP/1.1 200", 12) == 0);
+
+    close(s);
+    pthread_join(thread, NULL);
+    close(listener);
+    free(buf);
+}
+
+int main(void)
+{
+    test_pb_padded_lengths();
+    test_otlp_encode_sizes_and_decodes();
+    test_otlp_encode_reports_short_buffers();
+    test_otlp_post_to_collector();
+
+    printf("Tests passed!\n");
+    return 0;
+}
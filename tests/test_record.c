@@ -0,0 +1,168 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "../src/ngx_http_accounting_record.h"
+
+void check_uint(uint64_t v)
+{
+    char expected[32], buf[32];
+
+    snprintf(expected, sizeof(expected), "%llu", (unsigned long long) v);
+    *ngx_http_accounting_format_uint(buf, v) = '\0';
+
+    assert(strcmp(buf, expected) == 0);
+}
+
+void test_record_format_uint_matches_printf(void)
+{
+    uint64_t v;
+    int i;
+
+    check_uint(0);
+    check_uint(9);
+    check_uint(10);
+    check_uint(99);
+    check_uint(100);
+    check_uint(UINT64_MAX);
+
+    for (v = 1, i = 0; i < 19; i++, v *= 10) {
+        check_uint(v - 1);
+        check_uint(v);
+        check_uint(v + 1);
+    }
+
+    srand(3);
+    for (i = 0; i < 100000; i++) {
+        check_uint(((uint64_t) rand() << 40) ^ ((uint64_t) rand() << 20) ^ rand());
+    }
+}
+
+size_t write_record(char *buf, size_t size, unsigned format)
+{
+    ngx_http_accounting_record_t rec;
+
+    ngx_http_accounting_record_begin(&rec, buf, size, format);
+    ngx_http_accounting_record_uint(&rec, "pid", 42);
+    ngx_http_accounting_record_string(&rec, "id", "a\"b\tc", 5);
+    ngx_http_accounting_record_uint(&rec, "requests", 1234567);
+    ngx_http_accounting_record_extras(&rec);
+    ngx_http_accounting_record_fixed(&rec, "sample_rate", 0.25, 4);
+    ngx_http_accounting_record_list(&rec, "size_in");
+    ngx_http_accounting_record_pair(&rec, 0, 3);
+    ngx_http_accounting_record_pair(&rec, 10, 7);
+    ngx_http_accounting_record_list_end(&rec);
+    ngx_http_accounting_record_fixed(&rec, "burn", 1.005, 2);
+
+    return ngx_http_accounting_record_end(&rec);
+}
+
+void test_record_syslog_line(void)
+{
+    char buf[256];
+    size_t len = write_record(buf, sizeof(buf), NGX_HTTP_ACCOUNTING_RECORD_SYSLOG);
+
+    assert(strcmp(buf, "42|a\"b%09c|1234567|sample_rate=0.2500|size_in=0:3,10:7|burn=1.00") == 0
+           || strcmp(buf, "42|a\"b%09c|1234567|sample_rate=0.2500|size_in=0:3,10:7|burn=1.01") == 0);
+    assert(len == strlen(buf));
+}
+
+void test_record_syslog_escapes_separators(void)
+{
+    char buf[256];
+    ngx_http_accounting_record_t rec;
+
+    ngx_http_accounting_record_begin(&rec, buf, sizeof(buf), NGX_HTTP_ACCOUNTING_RECORD_SYSLOG);
+    ngx_http_accounting_record_uint(&rec, "rank", 1);
+    ngx_http_accounting_record_string(&rec, "uri", "/a|b\r\n%20\x7f?q=\"c\"\\", 17);
+    ngx_http_accounting_record_uint(&rec, "bytes", 5);
+    ngx_http_accounting_record_end(&rec);
+
+    assert(strcmp(buf, "1|/a%7cb%0d%0a%20%7f?q=\"c\"\\|5") == 0);
+}
+
+void test_record_tsv_line(void)
+{
+    char buf[256];
+    size_t len = write_record(buf, sizeof(buf), NGX_HTTP_ACCOUNTING_RECORD_TSV);
+
+    buf[len] = '\0';
+    assert(strncmp(buf, "42\ta\"b\\tc\t1234567\tsample_rate=0.2500\tsize_in=0:3,10:7\tburn=1.0", 60) == 0);
+    assert(buf[len - 1] == '\n');
+}
+
+void test_record_json_line(void)
+{
+    char buf[256];
+    size_t len = write_record(buf, sizeof(buf), NGX_HTTP_ACCOUNTING_RECORD_JSON);
+
+    buf[len] = '\0';
+    assert(strncmp(buf, "{\"pid\":42,\"id\":\"a\\\"b\\tc\",\"requests\":1234567,\"sample_rate\":0.2500,"
+                        "\"size_in\":{\"0\":3,\"10\":7},\"burn\":1.0", 96) == 0);
+    assert(strcmp(buf + len - 2, "}\n") == 0);
+}
+
+void test_record_fixed_pads_fraction(void)
+{
+    char buf[64];
+    ngx_http_accounting_record_t rec;
+
+    ngx_http_accounting_record_begin(&rec, buf, sizeof(buf), NGX_HTTP_ACCOUNTING_RECORD_SYSLOG);
+    ngx_http_accounting_record_fixed(&rec, "a", 3.0007, 4);
+    ngx_http_accounting_record_fixed(&rec, "b", -1, 2);
+    ngx_http_accounting_record_fixed(&rec, "c", 12.5, 0);
+    ngx_http_accounting_record_end(&rec);
+
+    assert(strcmp(buf, "3.0007|0.00|13") == 0);
+}
+
+void test_record_truncates_at_a_field(void)
+{
+    char buf[256];
+    size_t full, len, size;
+
+    full = write_record(buf, sizeof(buf), NGX_HTTP_ACCOUNTING_RECORD_JSON);
+
+    // every size gives a complete record made of whole fields
+    for (size = 4; size < full + 2; size++) {
+        len = write_record(buf, size, NGX_HTTP_ACCOUNTING_RECORD_JSON);
+        assert(len <= size);
+        assert(buf[0] == '{' && buf[len - 2] == '}' && buf[len - 1] == '\n');
+        assert(len == 3 || (buf[len - 3] >= '0' && buf[len - 3] <= '9') || buf[len - 3] == '"'
+               || buf[len - 3] == '}');
+    }
+}
+
+void test_record_exact_fill_then_no_room(void)
+{
+    char buf[256], *p;
+    size_t full, len;
+
+    full = write_record(buf, 128, NGX_HTTP_ACCOUNTING_RECORD_TSV);
+    memset(buf, 'x', sizeof(buf));
+
+    // a record ending at the last byte leaves nothing for the next one
+    len = write_record(buf, full, NGX_HTTP_ACCOUNTING_RECORD_TSV);
+    assert(len == full && buf[len - 1] == '\n');
+
+    p = buf + len;
+    assert(write_record(p, 0, NGX_HTTP_ACCOUNTING_RECORD_TSV) == 0);
+    assert(write_record(p, 1, NGX_HTTP_ACCOUNTING_RECORD_TSV) == 0);
+    assert(write_record(p, 2, NGX_HTTP_ACCOUNTING_RECORD_JSON) == 0);
+    assert(write_record(p, 0, NGX_HTTP_ACCOUNTING_RECORD_SYSLOG) == 0);
+    assert(p[0] == 'x' && p[1] == 'x');
+}
+
+int main()
+{
+    test_record_format_uint_matches_printf();
+    test_record_syslog_line();
+    test_record_syslog_escapes_separators();
+    test_record_tsv_line();
+    test_record_json_line();
+    test_record_fixed_pads_fraction();
+    test_record_truncates_at_a_field();
+    test_record_exact_fill_then_no_room();
+    printf("Tests passed!\n");
+    return 0;
+}
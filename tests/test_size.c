@@ -0,0 +1,47 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "../src/ngx_http_accounting_size.h"
+
+void test_size_empty_and_small(void)
+{
+    assert(ngx_http_accounting_size_bucket(-1) == 0);
+    assert(ngx_http_accounting_size_bucket(0) == 0);
+    assert(ngx_http_accounting_size_bucket(1) == 1);
+    assert(ngx_http_accounting_size_bucket(2) == 2);
+    assert(ngx_http_accounting_size_bucket(3) == 2);
+}
+
+void test_size_powers_of_two_start_a_bucket(void)
+{
+    unsigned n;
+
+    // 2^(n-1) opens bucket n, 2^(n-1) - 1 is the last size of the one below
+    for (n = 2; n < NGX_HTTP_ACCOUNTING_SIZE_BUCKETS; n++) {
+        assert(ngx_http_accounting_size_bucket((int64_t) 1 << (n - 1)) == n);
+        assert(ngx_http_accounting_size_bucket(((int64_t) 1 << (n - 1)) - 1) == n - 1);
+        assert(ngx_http_accounting_size_bucket(((int64_t) 1 << n) - 1) == n);
+    }
+}
+
+void test_size_top_bucket(void)
+{
+    assert(NGX_HTTP_ACCOUNTING_SIZE_BUCKETS == 32);
+
+    // everything from 1 GiB on
+    assert(ngx_http_accounting_size_bucket(((int64_t) 1 << 30) - 1) == 30);
+    assert(ngx_http_accounting_size_bucket((int64_t) 1 << 30) == 31);
+    assert(ngx_http_accounting_size_bucket((int64_t) 1 << 31) == 31);
+    assert(ngx_http_accounting_size_bucket((int64_t) 5 << 40) == 31);
+    assert(ngx_http_accounting_size_bucket(INT64_MAX) == 31);
+}
+
+int main()
+{
+    test_size_empty_and_small();
+    test_size_powers_of_two_start_a_bucket();
+    test_size_top_bucket();
+    printf("Tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,113 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <math.h>
+#include "../src/ngx_http_accounting_slo_window.h"
+
+ngx_http_accounting_slo_slot_t slots[NGX_HTTP_ACCOUNTING_SLO_SLOTS];
+
+void put(uint64_t minute, unsigned long requests, unsigned long errors, unsigned long slow)
+{
+    ngx_http_accounting_slo_slot_t *slot = ngx_http_accounting_slo_slot(slots, minute);
+
+    slot->minute = minute;
+    slot->requests = requests;
+    slot->errors = errors;
+    slot->slow = slow;
+}
+
+void test_slo_minutes_and_slots(void)
+{
+    assert(ngx_http_accounting_slo_minute(0) == 1);
+    assert(ngx_http_accounting_slo_minute(59) == 1);
+    assert(ngx_http_accounting_slo_minute(60) == 2);
+    assert(ngx_http_accounting_slo_minute(1700000000) == 1700000000 / 60 + 1);
+
+    assert(ngx_http_accounting_slo_slot(slots, 1) == &slots[1]);
+    assert(ngx_http_accounting_slo_slot(slots, 359) == &slots[359]);
+    assert(ngx_http_accounting_slo_slot(slots, 360) == &slots[0]);
+    assert(ngx_http_accounting_slo_slot(slots, 361) == &slots[1]);
+}
+
+void test_slo_window_across_wraparound(void)
+{
+    ngx_http_accounting_slo_sums_t sums;
+    uint64_t m;
+
+    memset(slots, 0, sizeof(slots));
+
+    // minutes 716 to 724 are the last slots of the ring and the first ones again
+    for (m = 716; m <= 724; m++) {
+        put(m, 10, 1, 2);
+    }
+
+    ngx_http_accounting_slo_window(slots, 724, 5, &sums);
+    assert(sums.requests == 50 && sums.errors == 5 && sums.slow == 10);
+
+    ngx_http_accounting_slo_window(slots, 724, 60, &sums);
+    assert(sums.requests == 90 && sums.errors == 9 && sums.slow == 18);
+
+    // windows longer than the ring are cut to it
+    ngx_http_accounting_slo_window(slots, 724, 1000, &sums);
+    assert(sums.requests == 90);
+
+    // a window that ended earlier
+    ngx_http_accounting_slo_window(slots, 719, 2, &sums);
+    assert(sums.requests == 20);
+}
+
+void test_slo_window_skips_stale_slots(void)
+{
+    ngx_http_accounting_slo_sums_t sums;
+
+    memset(slots, 0, sizeof(slots));
+
+    put(1000, 7, 0, 0);
+    put(1000 - NGX_HTTP_ACCOUNTING_SLO_SLOTS + 1, 100, 100, 100);  /* slot of 1001, 6 hours old */
+    put(998, 3, 1, 0);
+
+    ngx_http_accounting_slo_window(slots, 1001, 5, &sums);
+    assert(sums.requests == 10 && sums.errors == 1 && sums.slow == 0);
+}
+
+void test_slo_empty_window(void)
+{
+    ngx_http_accounting_slo_sums_t sums;
+
+    memset(slots, 0, sizeof(slots));
+
+    ngx_http_accounting_slo_window(slots, 5000, 60, &sums);
+    assert(sums.requests == 0 && sums.errors == 0 && sums.slow == 0);
+    assert(ngx_http_accounting_slo_burn_rate(sums.errors, sums.requests, 99900) == 0);
+
+    // zeroed slots of the first minutes after the epoch are not counted either
+    ngx_http_accounting_slo_window(slots, 1, 360, &sums);
+    assert(sums.requests == 0);
+}
+
+void test_slo_burn_rates(void)
+{
+    // 99.9% leaves 1 in 1000, spent exactly
+    assert(fabs(ngx_http_accounting_slo_burn_rate(1, 1000, 99900) - 1.0) < 1e-9);
+
+    // 99% leaves 1 in 100, spent 5 times faster
+    assert(fabs(ngx_http_accounting_slo_burn_rate(5, 100, 99000) - 5.0) < 1e-9);
+
+    // 99.5% of 2000 allows 10 bad ones
+    assert(fabs(ngx_http_accounting_slo_burn_rate(3, 2000, 99500) - 0.3) < 1e-9);
+
+    assert(ngx_http_accounting_slo_burn_rate(0, 1000, 99900) == 0);
+    assert(ngx_http_accounting_slo_burn_rate(0, 0, 99900) == 0);
+}
+
+int main()
+{
+    test_slo_minutes_and_slots();
+    test_slo_window_across_wraparound();
+    test_slo_window_skips_stale_slots();
+    test_slo_empty_window();
+    test_slo_burn_rates();
+    printf("Tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,216 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include <unistd.h>
+#include "../src/ngx_http_accounting_snapshot_format.h"
+
+#define NR_FILES    300
+#define NR_IDS      2000
+#define EXTRA_KIND  100
+
+int ngx_http_accounting_merge_files(char **paths, size_t n, unsigned threads,
+    unsigned char **out, size_t *out_len);
+
+static uint64_t expected_requests[NR_IDS];
+static uint64_t expected_classes[NR_IDS][10];
+static uint8_t  expected_extra[NR_IDS][16];
+static int      expected_present[NR_IDS];
+
+static char directory[] = "/tmp/test_snapshot_merge.XXXXXX";
+static char *paths[NR_FILES];
+
+
+void write_snapshot(const char *path, int file)
+{
+    ngx_http_accounting_snapshot_header_t header;
+    ngx_http_accounting_snapshot_column_t columns[3];
+    ngx_http_accounting_snapshot_t snap;
+    ngx_http_accounting_snapshot_id_t *ids;
+    unsigned char *buf;
+    size_t size;
+    int selected[NR_IDS];
+    int i, j, n = 0;
+    char name[32];
+
+    memset(&header, 0, sizeof(header));
+    memset(columns, 0, sizeof(columns));
+
+    for (i = 0; i < NR_IDS; i++) {
+        selected[i] = rand() % 10 == 0;
+        if (selected[i]) {
+            n++;
+            header.names_size += snprintf(name, sizeof(name), "tenant-%04d", i);
+        }
+    }
+
+    header.from = 1000 + file;
+    header.to = 1010 + file;
+    header.pid = file;
+    header.nr_ids = n;
+    header.nr_columns = file % 2 ? 3 : 2;
+
+    columns[0] = (ngx_http_accounting_snapshot_column_t) {
+        NGX_HTTP_ACCOUNTING_COL_REQUESTS, NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM, 8, 1, 0, 0 };
+    columns[1] = (ngx_http_accounting_snapshot_column_t) {
+        NGX_HTTP_ACCOUNTING_COL_STATUS_CLASSES, NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM, 8, 10, 0, 0 };
+    columns[2] = (ngx_http_accounting_snapshot_column_t) {
+        EXTRA_KIND, NGX_HTTP_ACCOUNTING_SNAPSHOT_MAX, 1, 16, 0, 0 };
+
+    size = ngx_http_accounting_snapshot_layout(NULL, &header, columns);
+    buf = malloc(size);
+    assert(buf != NULL);
+    ngx_http_accounting_snapshot_layout(buf, &header, columns);
+    assert(ngx_http_accounting_snapshot_open(&snap, buf, size) == 0);
+
+    ids = (ngx_http_accounting_snapshot_id_t *) (buf + header.ids_offset);
+
+    uint64_t offset = 0;
+    for (i = 0, n = 0; i < NR_IDS; i++) {
+        if (!selected[i]) {
+            continue;
+        }
+
+        int len = snprintf(name, sizeof(name), "tenant-%04d", i);
+        ids[n].name_offset = offset;
+        ids[n].name_len = len;
+        ids[n].level = 1;
+        memcpy(buf + header.names_offset + offset, name, len);
+        offset += len;
+
+        uint64_t requests = rand() % 1000;
+        *(uint64_t *) ngx_http_accounting_snapshot_row(&snap, 0, n) = requests;
+        expected_requests[i] += requests;
+        expected_present[i] = 1;
+
+        uint64_t *classes = ngx_http_accounting_snapshot_row(&snap, 1, n);
+        for (j = 0; j < 10; j++) {
+            classes[j] = rand() % 50;
+            expected_classes[i][j] += classes[j];
+        }
+
+        if (header.nr_columns == 3) {
+            uint8_t *extra = ngx_http_accounting_snapshot_row(&snap, 2, n);
+            for (j = 0; j < 16; j++) {
+                extra[j] = rand() % 256;
+                if (extra[j] > expected_extra[i][j]) {
+                    expected_extra[i][j] = extra[j];
+                }
+            }
+        }
+
+        n++;
+    }
+
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    assert(fwrite(buf, 1, size, f) == size);
+    fclose(f);
+    free(buf);
+}
+
+void check_merged(unsigned char *out, size_t len)
+{
+    ngx_http_accounting_snapshot_t snap;
+    size_t name_len;
+    uint32_t i, n;
+    int requests, classes, extra, j;
+    char name[32];
+
+    assert(ngx_http_accounting_snapshot_open(&snap, out, len) == 0);
+    assert(snap.header->from == 1000);
+    assert(snap.header->to == 1010 + NR_FILES - 1);
+    assert(snap.header->nr_columns == 3);
+
+    requests = ngx_http_accounting_snapshot_find_column(&snap, NGX_HTTP_ACCOUNTING_COL_REQUESTS);
+    classes = ngx_http_accounting_snapshot_find_column(&snap, NGX_HTTP_ACCOUNTING_COL_STATUS_CLASSES);
+    extra = ngx_http_accounting_snapshot_find_column(&snap, EXTRA_KIND);
+    assert(requests >= 0 && classes >= 0 && extra >= 0);
+
+    for (i = 0, n = 0; i < NR_IDS; i++) {
+        if (!expected_present[i]) {
+            continue;
+        }
+
+        snprintf(name, sizeof(name), "tenant-%04d", i);
+        const char *merged_name = ngx_http_accounting_snapshot_name(&snap, n, &name_len);
+        assert(name_len == strlen(name) && memcmp(merged_name, name, name_len) == 0);
+
+        assert(*(uint64_t *) ngx_http_accounting_snapshot_row(&snap, requests, n) == expected_requests[i]);
+        for (j = 0; j < 10; j++) {
+            assert(((uint64_t *) ngx_http_accounting_snapshot_row(&snap, classes, n))[j]
+                   == expected_classes[i][j]);
+        }
+        assert(memcmp(ngx_http_accounting_snapshot_row(&snap, extra, n), expected_extra[i], 16) == 0);
+
+        n++;
+    }
+
+    assert(n == snap.header->nr_ids);
+}
+
+void test_merge_snapshots_with_threads(void)
+{
+    unsigned char *out;
+    size_t len;
+
+    assert(ngx_http_accounting_merge_files(paths, NR_FILES, 4, &out, &len) == 0);
+    check_merged(out, len);
+    free(out);
+}
+
+void test_merge_snapshots_single_threaded_matches(void)
+{
+    unsigned char *one, *many;
+    size_t one_len, many_len;
+
+    assert(ngx_http_accounting_merge_files(paths, NR_FILES, 1, &one, &one_len) == 0);
+    assert(ngx_http_accounting_merge_files(paths, NR_FILES, 7, &many, &many_len) == 0);
+    assert(one_len == many_len && memcmp(one, many, one_len) == 0);
+    free(one);
+    free(many);
+}
+
+void test_merge_rejects_truncated_snapshot(void)
+{
+    char path[64];
+    char *bad[] = { paths[0], path };
+    unsigned char *out;
+    size_t len;
+
+    snprintf(path, sizeof(path), "%s/truncated.acct", directory);
+    FILE *f = fopen(path, "wb");
+    assert(f != NULL);
+    fwrite(NGX_HTTP_ACCOUNTING_SNAPSHOT_MAGIC, 1, 8, f);
+    fclose(f);
+
+    assert(ngx_http_accounting_merge_files(bad, 2, 1, &out, &len) != 0);
+    unlink(path);
+}
+
+int main()
+{
+    int i;
+
+    srand(42);
+    assert(mkdtemp(directory) != NULL);
+
+    for (i = 0; i < NR_FILES; i++) {
+        paths[i] = malloc(64);
+        snprintf(paths[i], 64, "%s/%d.acct", directory, i);
+        write_snapshot(paths[i], i);
+    }
+
+    test_merge_snapshots_with_threads();
+    test_merge_snapshots_single_threaded_matches();
+    test_merge_rejects_truncated_snapshot();
+
+    for (i = 0; i < NR_FILES; i++) {
+        unlink(paths[i]);
+        free(paths[i]);
+    }
+    rmdir(directory);
+
+    printf("Tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,104 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <string.h>
+#include "../src/ngx_http_accounting_top.h"
+
+void add_key(ngx_http_accounting_top_t *top, uint64_t key)
+{
+    ngx_http_accounting_top_entry_t entry;
+
+    memset(&entry, 0, sizeof(entry));
+    entry.key = key;
+    entry.latency_ms = key;
+    entry.uri_len = snprintf(entry.uri, sizeof(entry.uri), "/r/%llu", (unsigned long long) key);
+
+    if (ngx_http_accounting_top_admits(top, key)) {
+        ngx_http_accounting_top_add(top, &entry);
+    }
+}
+
+int cmp_desc(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void test_top_keeps_the_largest_keys_sorted(void)
+{
+    ngx_http_accounting_top_entry_t entries[8];
+    ngx_http_accounting_top_t top = { 8, 0, entries };
+    uint64_t keys[1000];
+    unsigned i;
+
+    srand(11);
+    for (i = 0; i < 1000; i++) {
+        keys[i] = rand() % 100000;
+        add_key(&top, keys[i]);
+    }
+
+    qsort(keys, 1000, sizeof(uint64_t), cmp_desc);
+    ngx_http_accounting_top_sort(&top);
+
+    assert(top.n == 8);
+    for (i = 0; i < 8; i++) {
+        char uri[32];
+        snprintf(uri, sizeof(uri), "/r/%llu", (unsigned long long) keys[i]);
+
+        assert(entries[i].key == keys[i]);
+        assert(entries[i].uri_len == strlen(uri) && memcmp(entries[i].uri, uri, entries[i].uri_len) == 0);
+    }
+}
+
+void test_top_fewer_requests_than_k(void)
+{
+    ngx_http_accounting_top_entry_t entries[4];
+    ngx_http_accounting_top_t top = { 4, 0, entries };
+
+    add_key(&top, 5);
+    add_key(&top, 20);
+    ngx_http_accounting_top_sort(&top);
+
+    assert(top.n == 2);
+    assert(entries[0].key == 20 && entries[1].key == 5);
+}
+
+void test_top_merge_keeps_the_subtree_top(void)
+{
+    ngx_http_accounting_top_entry_t a_entries[3], b_entries[3];
+    ngx_http_accounting_top_t a = { 3, 0, a_entries };
+    ngx_http_accounting_top_t b = { 3, 0, b_entries };
+
+    add_key(&a, 1);
+    add_key(&a, 50);
+    add_key(&a, 7);
+    add_key(&b, 40);
+    add_key(&b, 60);
+    add_key(&b, 2);
+
+    ngx_http_accounting_top_merge(&a, &b);
+    ngx_http_accounting_top_sort(&a);
+
+    assert(a.n == 3);
+    assert(a_entries[0].key == 60 && a_entries[1].key == 50 && a_entries[2].key == 40);
+}
+
+void test_top_ties_do_not_replace(void)
+{
+    ngx_http_accounting_top_entry_t entries[1];
+    ngx_http_accounting_top_t top = { 1, 0, entries };
+
+    add_key(&top, 9);
+    assert(!ngx_http_accounting_top_admits(&top, 9));
+    assert(ngx_http_accounting_top_admits(&top, 10));
+}
+
+int main()
+{
+    test_top_keeps_the_largest_keys_sorted();
+    test_top_fewer_requests_than_k();
+    test_top_merge_keeps_the_subtree_top();
+    test_top_ties_do_not_replace();
+    printf("Tests passed!\n");
+    return 0;
+}
@@ -0,0 +1,589 @@
+/*
+ * Merges accounting snapshots written by http_accounting_snapshot, e.g. of
+ * many hosts or workers, into one snapshot.
+ *
+ *   ngx_http_accounting_merge [-t threads] [-o out.acct] [-p] in.acct ...
+ *
+ * Inputs are split into one group per thread, every group is k-way merged
+ * into an in-memory snapshot and the group results are k-way merged once
+ * more. -p prints the result as text, one line per id, with the estimates
+ * of distinct count sketches instead of their registers.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../src/ngx_http_accounting_snapshot_format.h"
+#include "../src/ngx_http_accounting_hll.h"
+
+
+#define MERGE_MAX_COLUMNS  64
+
+typedef struct {
+    ngx_http_accounting_snapshot_t   snap;
+    void                            *map;
+    size_t                           len;
+} merge_input_t;
+
+typedef struct {
+    size_t                           input;
+    uint32_t                         pos;
+} merge_cursor_t;
+
+typedef struct {
+    char                           **paths;
+    size_t                           n;
+    unsigned char                   *out;
+    size_t                           out_len;
+    int                              rc;
+} merge_group_t;
+
+
+static int
+merge_cursor_cmp(merge_input_t *in, merge_cursor_t *a, merge_cursor_t *b)
+{
+    int          rc;
+    size_t       alen, blen;
+    const char  *aname, *bname;
+
+    aname = ngx_http_accounting_snapshot_name(&in[a->input].snap, a->pos, &alen);
+    bname = ngx_http_accounting_snapshot_name(&in[b->input].snap, b->pos, &blen);
+
+    rc = ngx_http_accounting_snapshot_name_cmp(aname, alen, bname, blen);
+    if (rc != 0) {
+        return rc;
+    }
+
+    return (a->input > b->input) - (a->input < b->input);
+}
+
+
+static void
+merge_heap_down(merge_input_t *in, merge_cursor_t *heap, size_t n, size_t i)
+{
+    size_t          child;
+    merge_cursor_t  tmp;
+
+    for ( ;; ) {
+        child = 2 * i + 1;
+        if (child >= n) {
+            return;
+        }
+
+        if (child + 1 < n && merge_cursor_cmp(in, &heap[child + 1], &heap[child]) < 0) {
+            child++;
+        }
+
+        if (merge_cursor_cmp(in, &heap[i], &heap[child]) <= 0) {
+            return;
+        }
+
+        tmp = heap[i];
+        heap[i] = heap[child];
+        heap[child] = tmp;
+        i = child;
+    }
+}
+
+
+static size_t
+merge_heap_init(merge_input_t *in, size_t nin, merge_cursor_t *heap)
+{
+    size_t  i, n;
+
+    n = 0;
+    for (i = 0; i < nin; i++) {
+        if (in[i].snap.header->nr_ids) {
+            heap[n].input = i;
+            heap[n].pos = 0;
+            n++;
+        }
+    }
+
+    for (i = n / 2; i-- > 0; /* void */) {
+        merge_heap_down(in, heap, n, i);
+    }
+
+    return n;
+}
+
+
+// advances the smallest cursor, returns the new heap size
+static size_t
+merge_heap_next(merge_input_t *in, merge_cursor_t *heap, size_t n)
+{
+    if (++heap[0].pos == in[heap[0].input].snap.header->nr_ids) {
+        heap[0] = heap[--n];
+    }
+
+    merge_heap_down(in, heap, n, 0);
+
+    return n;
+}
+
+
+static void
+merge_row(ngx_http_accounting_snapshot_column_t *c, void *dst, const void *src)
+{
+    uint32_t  i;
+
+#define merge_elements(type)                                                  \
+    for (i = 0; i < c->width; i++) {                                          \
+        type *d = (type *) dst + i, s = ((const type *) src)[i];              \
+        if (c->merge == NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM) {                   \
+            *d += s;                                                          \
+        } else if (s > *d) {                                                  \
+            *d = s;                                                           \
+        }                                                                     \
+    }
+
+    switch (c->elem_size) {
+    case 1:
+        merge_elements(uint8_t);
+        break;
+    case 2:
+        merge_elements(uint16_t);
+        break;
+    case 4:
+        merge_elements(uint32_t);
+        break;
+    default:
+        merge_elements(uint64_t);
+        break;
+    }
+
+#undef merge_elements
+}
+
+
+/*
+ * Merges opened snapshots into a newly allocated snapshot image. Columns are
+ * the union of all input columns, ids missing a column contribute nothing.
+ */
+int
+ngx_http_accounting_merge(merge_input_t *in, size_t nin, unsigned char **out, size_t *out_len)
+{
+    int                                     rc = -1;
+    int                                    *map = NULL;
+    char                                   *names;
+    size_t                                  i, n, len, last_len;
+    uint32_t                                j, k, nr_ids, col;
+    const char                             *name, *last;
+    unsigned char                          *buf = NULL;
+    merge_cursor_t                         *heap = NULL;
+    ngx_http_accounting_snapshot_t          result;
+    ngx_http_accounting_snapshot_id_t      *ids;
+    ngx_http_accounting_snapshot_header_t   header;
+    ngx_http_accounting_snapshot_column_t   columns[MERGE_MAX_COLUMNS];
+    const ngx_http_accounting_snapshot_column_t  *c;
+
+    memset(&header, 0, sizeof(header));
+
+    map = malloc(nin * MERGE_MAX_COLUMNS * sizeof(int));
+    heap = malloc((nin ? nin : 1) * sizeof(merge_cursor_t));
+    if (map == NULL || heap == NULL) {
+        goto done;
+    }
+
+    // union of the columns, the first input defines a column's shape
+    for (i = 0; i < nin; i++) {
+        const ngx_http_accounting_snapshot_header_t *h = in[i].snap.header;
+
+        if (i == 0 || h->from < header.from) {
+            header.from = h->from;
+        }
+        if (h->to > header.to) {
+            header.to = h->to;
+        }
+
+        if (h->nr_columns > MERGE_MAX_COLUMNS) {
+            fprintf(stderr, "too many columns\n");
+            goto done;
+        }
+
+        for (j = 0; j < h->nr_columns; j++) {
+            c = &in[i].snap.columns[j];
+
+            if (c->merge != NGX_HTTP_ACCOUNTING_SNAPSHOT_SUM
+                && c->merge != NGX_HTTP_ACCOUNTING_SNAPSHOT_MAX)
+            {
+                fprintf(stderr, "unknown merge operation %u of column %u\n", c->merge, c->kind);
+                goto done;
+            }
+
+            for (k = 0; k < header.nr_columns; k++) {
+                if (columns[k].kind == c->kind) {
+                    break;
+                }
+            }
+
+            if (k == header.nr_columns) {
+                if (k == MERGE_MAX_COLUMNS) {
+                    fprintf(stderr, "too many columns\n");
+                    goto done;
+                }
+                columns[k] = *c;
+                header.nr_columns++;
+
+            } else if (columns[k].width != c->width || columns[k].elem_size != c->elem_size
+                       || columns[k].merge != c->merge)
+            {
+                fprintf(stderr, "column %u differs between snapshots\n", c->kind);
+                goto done;
+            }
+
+            map[i * MERGE_MAX_COLUMNS + j] = k;
+        }
+    }
+
+    // first pass counts the distinct ids
+    last = NULL;
+    last_len = 0;
+
+    for (n = merge_heap_init(in, nin, heap); n; n = merge_heap_next(in, heap, n)) {
+        name = ngx_http_accounting_snapshot_name(&in[heap[0].input].snap, heap[0].pos, &len);
+
+        if (last == NULL || ngx_http_accounting_snapshot_name_cmp(last, last_len, name, len) != 0) {
+            header.nr_ids++;
+            header.names_size += len;
+            last = name;
+            last_len = len;
+        }
+    }
+
+    *out_len = ngx_http_accounting_snapshot_layout(NULL, &header, columns);
+
+    buf = malloc(*out_len);
+    if (buf == NULL) {
+        goto done;
+    }
+
+    (void) ngx_http_accounting_snapshot_layout(buf, &header, columns);
+
+    if (ngx_http_accounting_snapshot_open(&result, buf, *out_len) != 0) {
+        goto done;
+    }
+
+    ids = (ngx_http_accounting_snapshot_id_t *) (buf + header.ids_offset);
+    names = (char *) buf + header.names_offset;
+
+    // second pass merges the rows
+    nr_ids = 0;
+    last = NULL;
+    last_len = 0;
+
+    for (n = merge_heap_init(in, nin, heap); n; n = merge_heap_next(in, heap, n)) {
+        merge_input_t *input = &in[heap[0].input];
+
+        name = ngx_http_accounting_snapshot_name(&input->snap, heap[0].pos, &len);
+
+        if (last == NULL || ngx_http_accounting_snapshot_name_cmp(last, last_len, name, len) != 0) {
+            ids[nr_ids].name_offset = nr_ids ? ids[nr_ids - 1].name_offset + ids[nr_ids - 1].name_len : 0;
+            ids[nr_ids].name_len = len;
+            ids[nr_ids].level = input->snap.ids[heap[0].pos].level;
+            memcpy(names + ids[nr_ids].name_offset, name, len);
+            nr_ids++;
+            last = name;
+            last_len = len;
+        }
+
+        for (j = 0; j < input->snap.header->nr_columns; j++) {
+            col = map[heap[0].input * MERGE_MAX_COLUMNS + j];
+            merge_row(&columns[col], ngx_http_accounting_snapshot_row(&result, col, nr_ids - 1),
+                      ngx_http_accounting_snapshot_row(&input->snap, j, heap[0].pos));
+        }
+    }
+
+    *out = buf;
+    buf = NULL;
+    rc = 0;
+
+done:
+
+    free(buf);
+    free(heap);
+    free(map);
+
+    return rc;
+}
+
+
+static int
+merge_load(merge_input_t *input, const char *path)
+{
+    int          fd;
+    struct stat  st;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        fprintf(stderr, "open(\"%s\") failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (fstat(fd, &st) == -1 || st.st_size == 0) {
+        fprintf(stderr, "\"%s\" is empty or can not be read\n", path);
+        close(fd);
+        return -1;
+    }
+
+    input->len = st.st_size;
+    input->map = mmap(NULL, input->len, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (input->map == MAP_FAILED) {
+        input->map = NULL;
+        fprintf(stderr, "mmap(\"%s\") failed: %s\n", path, strerror(errno));
+        return -1;
+    }
+
+    if (ngx_http_accounting_snapshot_open(&input->snap, input->map, input->len) != 0) {
+        fprintf(stderr, "\"%s\" is not a valid snapshot\n", path);
+        return -1;
+    }
+
+    return 0;
+}
+
+
+static void *
+merge_group(void *data)
+{
+    size_t          i;
+    merge_group_t  *group = data;
+    merge_input_t  *in;
+
+    group->rc = -1;
+
+    in = calloc(group->n ? group->n : 1, sizeof(merge_input_t));
+    if (in == NULL) {
+        return NULL;
+    }
+
+    for (i = 0; i < group->n; i++) {
+        if (merge_load(&in[i], group->paths[i]) != 0) {
+            goto done;
+        }
+    }
+
+    group->rc = ngx_http_accounting_merge(in, group->n, &group->out, &group->out_len);
+
+done:
+
+    for (i = 0; i < group->n; i++) {
+        if (in[i].map) {
+            munmap(in[i].map, in[i].len);
+        }
+    }
+
+    free(in);
+
+    return NULL;
+}
+
+
+int
+ngx_http_accounting_merge_files(char **paths, size_t n, unsigned threads, unsigned char **out,
+    size_t *out_len)
+{
+    int              rc = -1;
+    size_t           i, nr_groups, started;
+    pthread_t       *tids;
+    merge_group_t   *groups;
+    merge_input_t   *in;
+
+    nr_groups = threads > 1 && n > threads ? threads : 1;
+
+    groups = calloc(nr_groups, sizeof(merge_group_t));
+    tids = calloc(nr_groups, sizeof(pthread_t));
+    in = calloc(nr_groups, sizeof(merge_input_t));
+    if (groups == NULL || tids == NULL || in == NULL) {
+        goto done;
+    }
+
+    for (i = 0; i < nr_groups; i++) {
+        groups[i].paths = paths + i * n / nr_groups;
+        groups[i].n = (i + 1) * n / nr_groups - i * n / nr_groups;
+    }
+
+    if (nr_groups == 1) {
+        merge_group(&groups[0]);
+        rc = groups[0].rc;
+        *out = groups[0].out;
+        *out_len = groups[0].out_len;
+        groups[0].out = NULL;
+        goto done;
+    }
+
+    for (started = 0; started < nr_groups; started++) {
+        if (pthread_create(&tids[started], NULL, merge_group, &groups[started]) != 0) {
+            fprintf(stderr, "pthread_create() failed\n");
+            break;
+        }
+    }
+
+    for (i = 0; i < started; i++) {
+        pthread_join(tids[i], NULL);
+    }
+
+    if (started < nr_groups) {
+        goto done;
+    }
+
+    for (i = 0; i < nr_groups; i++) {
+        if (groups[i].rc != 0
+            || ngx_http_accounting_snapshot_open(&in[i].snap, groups[i].out, groups[i].out_len) != 0)
+        {
+            goto done;
+        }
+    }
+
+    rc = ngx_http_accounting_merge(in, nr_groups, out, out_len);
+
+done:
+
+    if (groups) {
+        for (i = 0; i < nr_groups; i++) {
+            free(groups[i].out);
+        }
+    }
+
+    free(groups);
+    free(tids);
+    free(in);
+
+    return rc;
+}
+
+
+#ifndef TESTING
+
+static void
+merge_print(ngx_http_accounting_snapshot_t *snap)
+{
+    size_t                                        len;
+    uint32_t                                      i, j, k;
+    const char                                   *name;
+    const unsigned char                          *row;
+    const ngx_http_accounting_snapshot_column_t  *c;
+
+    for (i = 0; i < snap->header->nr_ids; i++) {
+        name = ngx_http_accounting_snapshot_name(snap, i, &len);
+        printf("%llu|%llu|%.*s|%u", (unsigned long long) snap->header->from,
+               (unsigned long long) snap->header->to, (int) len, name, snap->ids[i].level);
+
+        for (j = 0; j < snap->header->nr_columns; j++) {
+            c = &snap->columns[j];
+            row = ngx_http_accounting_snapshot_row(snap, j, i);
+
+            printf("|%u=", c->kind);
+
+            // sketches are printed as their estimate
+            if (c->kind >= NGX_HTTP_ACCOUNTING_COL_DISTINCT && c->elem_size == 1
+                && c->width >= (1u << NGX_HTTP_ACCOUNTING_HLL_MIN_PRECISION)
+                && (c->width & (c->width - 1)) == 0)
+            {
+                printf("%llu", (unsigned long long)
+                       ngx_http_accounting_hll_estimate(row, __builtin_ctz(c->width)));
+                continue;
+            }
+
+            for (k = 0; k < c->width; k++) {
+                unsigned long long v;
+
+                switch (c->elem_size) {
+                case 1: v = row[k]; break;
+                case 2: v = ((const uint16_t *) row)[k]; break;
+                case 4: v = ((const uint32_t *) row)[k]; break;
+                default: v = ((const uint64_t *) row)[k]; break;
+                }
+
+                printf(k ? ",%llu" : "%llu", v);
+            }
+        }
+
+        printf("\n");
+    }
+}
+
+
+int
+main(int argc, char **argv)
+{
+    int                              opt, print = 0;
+    char                            *output = NULL;
+    long                             threads;
+    size_t                           out_len, off;
+    ssize_t                          n;
+    unsigned char                   *out;
+    ngx_http_accounting_snapshot_t   snap;
+
+    threads = sysconf(_SC_NPROCESSORS_ONLN);
+
+    while ((opt = getopt(argc, argv, "o:t:p")) != -1) {
+        switch (opt) {
+        case 'o':
+            output = optarg;
+            break;
+        case 't':
+            threads = atol(optarg);
+            break;
+        case 'p':
+            print = 1;
+            break;
+        default:
+            goto usage;
+        }
+    }
+
+    if (optind == argc || (output == NULL && !print)) {
+        goto usage;
+    }
+
+    if (ngx_http_accounting_merge_files(argv + optind, argc - optind,
+                                        threads > 0 ? threads : 1, &out, &out_len)
+        != 0)
+    {
+        return 1;
+    }
+
+    if (output) {
+        int fd = open(output, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+        if (fd == -1) {
+            fprintf(stderr, "open(\"%s\") failed: %s\n", output, strerror(errno));
+            return 1;
+        }
+
+        for (off = 0; off < out_len; off += n) {
+            n = write(fd, out + off, out_len - off);
+            if (n == -1) {
+                fprintf(stderr, "write(\"%s\") failed: %s\n", output, strerror(errno));
+                return 1;
+            }
+        }
+
+        close(fd);
+    }
+
+    if (print && ngx_http_accounting_snapshot_open(&snap, out, out_len) == 0) {
+        merge_print(&snap);
+    }
+
+    free(out);
+
+    return 0;
+
+usage:
+
+    fprintf(stderr, "usage: %s [-t threads] [-o out.acct] [-p] in.acct ...\n", argv[0]);
+
+    return 1;
+}
+
+#endif